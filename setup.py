@@ -0,0 +1,18 @@
+# builds the sudoku_solver Python extension module with `pip install .`
+import sys
+
+from setuptools import Extension, setup
+
+setup(
+    name="sudoku-solver",
+    version="1.0",
+    description="Python bindings to the C Sudoku solver",
+    ext_modules=[
+        Extension(
+            "sudoku_solver",
+            sources=["sudoku-module.c", "sudoku-solver.c"],
+            define_macros=[("SUDOKU_LIBRARY", None)],
+            libraries=[] if sys.platform == "win32" else ["pthread"],
+        )
+    ],
+)
@@ -0,0 +1,138 @@
+// benchmark for the solver core: solves the classic puzzles in each file given with every policy
+// (or only the policy given by -p), -r times over, and prints the throughput and latency of each run
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sudoku-solver.h"
+
+static const char *policy_names[] = {"logic", "fixed", "adaptive", "guess"};
+
+// parse the classic puzzles in a file, skipping invalid lines and variant puzzles
+// return the number of puzzles and set puzzles to an array that must be freed, or return -1 on error
+static int load_puzzles(const char *path, board **puzzles)
+{
+    size_t size;
+    char *data = read_file(path, &size);
+    if (data == 0)
+    {
+        return -1;
+    }
+    // every puzzle takes at least 82 bytes including its newline, so this is enough room
+    *puzzles = malloc(sizeof(board) * (size / 82 + 1));
+    if (*puzzles == 0)
+    {
+        free(data);
+        return -1;
+    }
+    int count = 0;
+    int line_num = 0;
+    int len;
+    const char *line;
+    const char *curr = data;
+    while ((line = next_line(&curr, data + size, &len, &line_num)) != 0)
+    {
+        int err_pos;
+        if (parse_record(line, len, &(*puzzles)[count], &err_pos) == PARSE_OK)
+        {
+            count++;
+        }
+    }
+    free(data);
+    return count;
+}
+
+// solve every puzzle repeats times with the given policy, then print the throughput and latency
+static void run_benchmark(const char *path, const board *puzzles, int count, int policy, int repeats)
+{
+    metrics stats;
+    memset(&stats, 0, sizeof(stats));
+    scheduler sched;
+    init_scheduler(&sched, policy);
+    unsigned long long start_ns = now_ns();
+    for (int r = 0; r < repeats; r++)
+    {
+        for (int n = 0; n < count; n++)
+        {
+            board puzzle = puzzles[n];
+            unsigned long long puzzle_start = now_ns();
+            int count_unsolved = solve_board(&puzzle, &sched, 0);
+            record_puzzle(&stats, now_ns() - puzzle_start, count_unsolved == 0);
+        }
+    }
+    double seconds = (now_ns() - start_ns) / 1e9;
+    unsigned long long total = stats.solved + stats.unsolved;
+    printf("%s, %s: %llu puzzles (%llu unsolved) in %.3f seconds, %.0f per second\n", path, policy_names[policy], total,
+           stats.unsolved, seconds, (seconds > 0) ? (total / seconds) : 0.0);
+    printf("    median %.1f, 99th percentile %.1f, max %.1f microseconds, %llu guesses\n", latency_quantile(&stats, 0.5) / 1e3,
+           latency_quantile(&stats, 0.99) / 1e3, stats.max_ns / 1e3, sched.guesses);
+}
+
+int main(int argc, char *argv[])
+{
+    int policy = -1;
+    int repeats = 1;
+    int count_files = 0;
+    int result = 0;
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if ((strcmp(argv[arg], "-p") == 0) && (arg + 1 < argc))
+        {
+            arg++;
+            policy = -2;
+            for (int p = 0; p < 4; p++)
+            {
+                if (strcmp(argv[arg], policy_names[p]) == 0)
+                {
+                    policy = p;
+                }
+            }
+        }
+        else if ((strcmp(argv[arg], "-r") == 0) && (arg + 1 < argc))
+        {
+            repeats = atoi(argv[++arg]);
+        }
+        else if (argv[arg][0] != '-')
+        {
+            count_files++;
+        }
+        else
+        {
+            policy = -2;
+        }
+    }
+    if ((policy == -2) || (repeats < 1) || (count_files == 0))
+    {
+        fprintf(stderr, "Usage: %s [-p logic|fixed|adaptive|guess] [-r repeats] puzzle file...\n", argv[0]);
+        return 1;
+    }
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if ((strcmp(argv[arg], "-p") == 0) || (strcmp(argv[arg], "-r") == 0))
+        {
+            arg++;
+            continue;
+        }
+        board *puzzles;
+        int count = load_puzzles(argv[arg], &puzzles);
+        if (count < 0)
+        {
+            result = 1;
+            continue;
+        }
+        if (count == 0)
+        {
+            printf("%s: no classic puzzles\n", argv[arg]);
+        }
+        for (int p = 0; p < 4; p++)
+        {
+            if ((count > 0) && ((policy < 0) || (policy == p)))
+            {
+                run_benchmark(argv[arg], puzzles, count, p, repeats);
+            }
+        }
+        free(puzzles);
+    }
+    return result;
+}
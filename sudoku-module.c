@@ -0,0 +1,426 @@
+// Python extension module around the C solver, for solving large batches of puzzles from Python
+// build it with `pip install .`, which compiles this file together with sudoku-solver.c
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "sudoku-solver.h"
+
+// status of each puzzle in a batch
+#define STATUS_SOLVED 0
+#define STATUS_UNSOLVED 1
+#define STATUS_INVALID 2
+
+// puzzles handed to a thread at a time, and the most threads used for one batch
+#define CHUNK_SIZE 256
+#define MAX_THREADS 256
+
+static const char *policy_names[] = {"logic", "fixed", "adaptive", "guess"};
+
+// a batch of puzzles and the arrays its results are written to, shared by every thread solving it
+// thread t solves chunks t, t + threads, t + 2 * threads, and so on, so that runs of hard puzzles are spread out
+typedef struct Batch
+{
+    const unsigned char *puzzles;
+    unsigned char *solutions, *status;
+    unsigned int *guesses;
+    unsigned long long *ns;
+    Py_ssize_t size;
+    int policy, threads;
+} batch;
+
+// one thread's share of a batch; each thread has its own scheduler and metrics, so no state is shared
+// while solving, and their counts are merged into the module's totals once the batch is done
+typedef struct Worker
+{
+    batch *work;
+    int index;
+    scheduler sched;
+    metrics stats;
+} worker;
+
+// counts for every puzzle the module has solved, reported by metrics() and write_metrics();
+// only read or changed while holding the GIL
+static scheduler total_sched;
+static metrics total_stats;
+
+// return the policy with the given name, or -1 if there is none
+static int find_policy(const char *name)
+{
+    for (int p = 0; p < 4; p++)
+    {
+        if (strcmp(name, policy_names[p]) == 0)
+        {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// solve one puzzle given as 81 values from 0 (blank) to 9, writing the solution (or the partial solution,
+// or the puzzle itself if it is invalid) to solution, and return its status
+static int solve_values(const unsigned char *values, unsigned char *solution, scheduler *sched)
+{
+    board puzzle;
+    int err_pos;
+    memcpy(puzzle.value, values, 81);
+    memcpy(solution, values, 81);
+    for (int n = 0; n < 81; n++)
+    {
+        if (values[n] > 9)
+        {
+            return STATUS_INVALID;
+        }
+    }
+    if (check_contradictions(&puzzle, &err_pos) != PARSE_OK)
+    {
+        return STATUS_INVALID;
+    }
+    int count_unsolved = solve_board(&puzzle, sched, 0);
+    memcpy(solution, puzzle.value, 81);
+    return count_unsolved ? STATUS_UNSOLVED : STATUS_SOLVED;
+}
+
+// solve every chunk of the batch that belongs to one thread
+static void solve_chunks(worker *w)
+{
+    batch *work = w->work;
+    for (Py_ssize_t start = (Py_ssize_t)w->index * CHUNK_SIZE; start < work->size; start += (Py_ssize_t)work->threads * CHUNK_SIZE)
+    {
+        Py_ssize_t stop = (start + CHUNK_SIZE < work->size) ? (start + CHUNK_SIZE) : work->size;
+        for (Py_ssize_t n = start; n < stop; n++)
+        {
+            unsigned long long guesses = w->sched.guesses;
+            unsigned long long start_ns = now_ns();
+            work->status[n] = (unsigned char)solve_values(work->puzzles + (81 * n), work->solutions + (81 * n), &w->sched);
+            work->ns[n] = now_ns() - start_ns;
+            work->guesses[n] = (unsigned int)(w->sched.guesses - guesses);
+            if (work->status[n] == STATUS_INVALID)
+            {
+                w->stats.invalid++;
+            }
+            else
+            {
+                record_puzzle(&w->stats, work->ns[n], work->status[n] == STATUS_SOLVED);
+            }
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI run_worker(LPVOID arg)
+{
+    solve_chunks((worker *)arg);
+    return 0;
+}
+#else
+static void *run_worker(void *arg)
+{
+    solve_chunks((worker *)arg);
+    return 0;
+}
+#endif
+
+// return the number of processors available, which is the default number of threads
+static int count_processors()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+#endif
+}
+
+// solve a batch with the given number of threads and one worker for each, solving a thread's share
+// in the calling thread if it could not be started; called without holding the GIL
+static void solve_batch(batch *work, worker *workers)
+{
+#ifdef _WIN32
+    HANDLE handles[MAX_THREADS];
+#else
+    pthread_t handles[MAX_THREADS];
+#endif
+    int started[MAX_THREADS];
+    for (int t = 0; t < work->threads; t++)
+    {
+        workers[t].work = work;
+        workers[t].index = t;
+        init_scheduler(&workers[t].sched, work->policy);
+        memset(&workers[t].stats, 0, sizeof(workers[t].stats));
+#ifdef _WIN32
+        handles[t] = (t > 0) ? CreateThread(0, 0, run_worker, &workers[t], 0, 0) : 0;
+        started[t] = (handles[t] != 0);
+#else
+        started[t] = (t > 0) && (pthread_create(&handles[t], 0, run_worker, &workers[t]) == 0);
+#endif
+    }
+    for (int t = 0; t < work->threads; t++)
+    {
+        if (!started[t])
+        {
+            solve_chunks(&workers[t]);
+        }
+    }
+    for (int t = 0; t < work->threads; t++)
+    {
+        if (started[t])
+        {
+#ifdef _WIN32
+            WaitForSingleObject(handles[t], INFINITE);
+            CloseHandle(handles[t]);
+#else
+            pthread_join(handles[t], 0);
+#endif
+        }
+    }
+}
+
+// return a memoryview with the given format and shape over a new bytearray of size items,
+// setting data to the start of the bytearray
+static PyObject *new_array(Py_ssize_t size, Py_ssize_t itemsize, const char *format, PyObject *shape, char **data)
+{
+    PyObject *bytes = PyByteArray_FromStringAndSize(0, size * itemsize);
+    if (bytes == 0)
+    {
+        return 0;
+    }
+    *data = PyByteArray_AS_STRING(bytes);
+    PyObject *view = PyMemoryView_FromObject(bytes);
+    Py_DECREF(bytes);
+    if (view == 0)
+    {
+        return 0;
+    }
+    // memoryview can't cast to a shape containing 0, so an empty batch gets flat empty views
+    PyObject *result = size ? PyObject_CallMethod(view, "cast", "sO", format, shape) : PyObject_CallMethod(view, "cast", "s", format);
+    Py_DECREF(view);
+    return result;
+}
+
+PyDoc_STRVAR(solve_many_doc,
+             "solve_many(puzzles, policy='adaptive', threads=0)\n"
+             "--\n\n"
+             "Solve a batch of classic puzzles in parallel.\n\n"
+             "puzzles is a C-contiguous buffer of unsigned bytes, such as a NumPy uint8 array of shape (N, 81),\n"
+             "holding each puzzle's squares row by row with 0 for a blank. threads=0 uses one thread per processor.\n"
+             "Returns (solutions, status, guesses, ns) as memoryviews, which numpy.asarray wraps without copying:\n"
+             "solutions has shape (N, 81) and holds the solution, partial solution, or (if invalid) the puzzle itself;\n"
+             "status is 0 if solved, 1 if unsolved, and 2 if invalid; guesses and ns give the guesses made and the\n"
+             "nanoseconds taken for each puzzle.");
+
+static PyObject *solve_many(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"puzzles", "policy", "threads", 0};
+    PyObject *input;
+    const char *policy_name = "adaptive";
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|si", keywords, &input, &policy_name, &threads))
+    {
+        return 0;
+    }
+    int policy = find_policy(policy_name);
+    if (policy < 0)
+    {
+        PyErr_Format(PyExc_ValueError, "unknown policy '%s'", policy_name);
+        return 0;
+    }
+
+    // accept an array of shape (N, 81), or a flat buffer holding a whole number of puzzles
+    Py_buffer view;
+    if (PyObject_GetBuffer(input, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+    {
+        return 0;
+    }
+    int shape_ok = (view.ndim == 2) ? (view.shape[1] == 81) : ((view.ndim == 1) && ((view.len % 81) == 0));
+    if ((view.itemsize != 1) || ((view.format != 0) && (strcmp(view.format, "B") != 0)) || !shape_ok)
+    {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "puzzles must be a uint8 array of shape (N, 81)");
+        return 0;
+    }
+
+    batch work;
+    work.puzzles = (const unsigned char *)view.buf;
+    work.size = view.len / 81;
+    work.policy = policy;
+    Py_ssize_t chunks = (work.size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    work.threads = (threads > 0) ? threads : count_processors();
+    work.threads = (work.threads > MAX_THREADS) ? MAX_THREADS : work.threads;
+    work.threads = (work.threads > chunks) ? (int)chunks : work.threads;
+
+    // the results are written straight into the arrays returned to Python
+    char *solutions_data = 0, *status_data = 0, *guesses_data = 0, *ns_data = 0;
+    PyObject *solutions = 0, *status = 0, *guesses = 0, *ns = 0;
+    PyObject *grid_shape = Py_BuildValue("(nn)", work.size, (Py_ssize_t)81);
+    PyObject *list_shape = Py_BuildValue("(n)", work.size);
+    if (grid_shape && list_shape)
+    {
+        solutions = new_array(work.size * 81, 1, "B", grid_shape, &solutions_data);
+        status = new_array(work.size, 1, "B", list_shape, &status_data);
+        guesses = new_array(work.size, sizeof(unsigned int), "I", list_shape, &guesses_data);
+        ns = new_array(work.size, sizeof(unsigned long long), "Q", list_shape, &ns_data);
+    }
+    Py_XDECREF(grid_shape);
+    Py_XDECREF(list_shape);
+    // workers are allocated rather than kept on the stack, since each holds a latency histogram
+    worker *workers = PyMem_Calloc((work.threads > 0) ? work.threads : 1, sizeof(worker));
+    PyObject *result = 0;
+    if (workers == 0)
+    {
+        PyErr_NoMemory();
+    }
+    else if (solutions && status && guesses && ns)
+    {
+        work.solutions = (unsigned char *)solutions_data;
+        work.status = (unsigned char *)status_data;
+        work.guesses = (unsigned int *)guesses_data;
+        work.ns = (unsigned long long *)ns_data;
+        // the input buffer stays exported until it is released, so it can't be resized while the GIL is released
+        Py_BEGIN_ALLOW_THREADS
+        if (work.threads > 0)
+        {
+            solve_batch(&work, workers);
+        }
+        Py_END_ALLOW_THREADS
+        for (int t = 0; t < work.threads; t++)
+        {
+            merge_scheduler(&total_sched, &workers[t].sched);
+            merge_metrics(&total_stats, &workers[t].stats);
+        }
+        result = PyTuple_Pack(4, solutions, status, guesses, ns);
+    }
+    Py_XDECREF(solutions);
+    Py_XDECREF(status);
+    Py_XDECREF(guesses);
+    Py_XDECREF(ns);
+    PyMem_Free(workers);
+    PyBuffer_Release(&view);
+    return result;
+}
+
+PyDoc_STRVAR(solve_doc,
+             "solve(puzzle, policy='adaptive')\n"
+             "--\n\n"
+             "Solve one classic puzzle given as an 81-character string, with 0 or . for a blank.\n"
+             "Returns the solution as an 81-character string, with 0 for squares left unsolved,\n"
+             "and raises ValueError if the puzzle is invalid.");
+
+static PyObject *solve(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"puzzle", "policy", 0};
+    const char *str;
+    Py_ssize_t len;
+    const char *policy_name = "adaptive";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#|s", keywords, &str, &len, &policy_name))
+    {
+        return 0;
+    }
+    int policy = find_policy(policy_name);
+    if (policy < 0)
+    {
+        PyErr_Format(PyExc_ValueError, "unknown policy '%s'", policy_name);
+        return 0;
+    }
+    board puzzle;
+    int err_pos;
+    // any string longer than a puzzle is reported as the wrong length
+    int err = parse_record(str, (len > 81) ? 82 : (int)len, &puzzle, &err_pos);
+    if (err != PARSE_OK)
+    {
+        total_stats.invalid++;
+        PyErr_Format(PyExc_ValueError, "position %d: %s", err_pos + 1, parse_error_message(err));
+        return 0;
+    }
+    scheduler sched;
+    init_scheduler(&sched, policy);
+    unsigned long long start_ns = now_ns();
+    int count_unsolved = solve_board(&puzzle, &sched, 0);
+    record_puzzle(&total_stats, now_ns() - start_ns, count_unsolved == 0);
+    merge_scheduler(&total_sched, &sched);
+    char solution[81];
+    for (int n = 0; n < 81; n++)
+    {
+        solution[n] = (char)('0' + puzzle.value[n]);
+    }
+    return PyUnicode_FromStringAndSize(solution, 81);
+}
+
+PyDoc_STRVAR(get_metrics_doc,
+             "metrics()\n"
+             "--\n\n"
+             "Return a dict of counts for every puzzle solved so far by solve_many and solve, merged from\n"
+             "the counts kept by each thread: the puzzles solved, unsolved, and invalid, the guesses made,\n"
+             "and the median, 99th percentile, longest, and total nanoseconds taken per puzzle.");
+
+static PyObject *get_metrics(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue("{sKsKsKsKsKsKsKsK}", "solved", total_stats.solved, "unsolved", total_stats.unsolved,
+                         "invalid", total_stats.invalid, "guesses", total_sched.guesses,
+                         "median_ns", latency_quantile(&total_stats, 0.5), "p99_ns", latency_quantile(&total_stats, 0.99),
+                         "max_ns", total_stats.max_ns, "total_ns", total_stats.latency_ns);
+}
+
+PyDoc_STRVAR(save_metrics_doc,
+             "write_metrics(path)\n"
+             "--\n\n"
+             "Write the counts for every puzzle solved so far, along with the time and eliminations of each\n"
+             "technique, to path in the Prometheus text format, the same as the command-line solver's -m option.\n"
+             "Raises OSError if the file could not be written.");
+
+static PyObject *save_metrics(PyObject *self, PyObject *args)
+{
+    const char *path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+    {
+        return 0;
+    }
+    if (write_metrics(path, &total_stats, &total_sched))
+    {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return 0;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef sudoku_methods[] = {
+    {"solve_many", (PyCFunction)(void (*)(void))solve_many, METH_VARARGS | METH_KEYWORDS, solve_many_doc},
+    {"solve", (PyCFunction)(void (*)(void))solve, METH_VARARGS | METH_KEYWORDS, solve_doc},
+    {"metrics", get_metrics, METH_NOARGS, get_metrics_doc},
+    {"write_metrics", save_metrics, METH_VARARGS, save_metrics_doc},
+    {0, 0, 0, 0},
+};
+
+static struct PyModuleDef sudoku_module = {
+    PyModuleDef_HEAD_INIT,
+    "sudoku_solver",
+    "Bindings to the C Sudoku solver.",
+    -1,
+    sudoku_methods,
+};
+
+PyMODINIT_FUNC PyInit_sudoku_solver(void)
+{
+    init_scheduler(&total_sched, POLICY_ADAPTIVE);
+    PyObject *module = PyModule_Create(&sudoku_module);
+    if (module == 0)
+    {
+        return 0;
+    }
+    if ((PyModule_AddIntConstant(module, "SOLVED", STATUS_SOLVED) < 0) ||
+        (PyModule_AddIntConstant(module, "UNSOLVED", STATUS_UNSOLVED) < 0) ||
+        (PyModule_AddIntConstant(module, "INVALID", STATUS_INVALID) < 0))
+    {
+        Py_DECREF(module);
+        return 0;
+    }
+    return module;
+}
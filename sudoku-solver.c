@@ -2,6 +2,182 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef SUDOKU_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+#include "sudoku-solver.h"
+
+// number of calls before the adaptive policy trusts the measured yield of a technique, and how many
+// puzzles skip a technique before it is retried anyway; the wait doubles, up to SCHED_MAX_PROBE,
+// each time the retried technique is still slower than guessing
+#define SCHED_WARMUP 16
+#define SCHED_PROBE 64
+#define SCHED_MAX_PROBE 4096
+
+// how often a long batch rewrites its metrics file, in nanoseconds
+#define METRICS_INTERVAL_NS 1000000000ULL
+
+// with -DSUDOKU_DISPATCH, the variant engine's loops are compiled for several x86-64 levels and the best one
+// for the processor is chosen when the program starts; counting possibilities is a single popcnt from x86-64-v2 on
+#if defined(SUDOKU_DISPATCH) && defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && !defined(__clang__)
+#define DISPATCH __attribute__((target_clones("default", "arch=x86-64-v2", "arch=x86-64-v3")))
+#else
+#define DISPATCH
+#endif
+
+#ifdef SUDOKU_PROFILE
+// phases of the solver that are timed separately when profiling
+#define PHASE_SETUP 0
+#define PHASE_UPDATE 1
+#define PHASE_UNIQUE 2
+#define PHASE_PAIRS 3
+#define PHASE_TRIPLES 4
+#define PHASE_SEARCH 5
+#define NUM_PHASES 6
+
+static const char *phase_names[NUM_PHASES] = {"setup", "update_unsolved", "find/check_unique", "check_pairs", "check_triples", "search"};
+
+// totals collected over every puzzle solved since the program started
+typedef struct Profile
+{
+    int puzzles;
+    // calls[p] counts how many times phase p ran, and ticks[p] the cycles (or nanoseconds) spent in it
+    unsigned long long calls[NUM_PHASES], ticks[NUM_PHASES];
+    // hardware counters for each phase, only collected if perf_event is available
+    unsigned long long cache_misses[NUM_PHASES], branch_misses[NUM_PHASES];
+    // start of the phase currently being timed
+    unsigned long long start_ticks, start_cache_misses, start_branch_misses;
+    // perf_event group leader file descriptor, 0 before setup and -1 if unavailable
+    int perf_fd;
+} profile;
+
+static profile prof;
+
+// read the cycle counter, or a nanosecond clock where there is no cycle counter
+static unsigned long long read_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+#ifdef __linux__
+// open one hardware counter for this process, in the group led by group_fd (or a new group if -1)
+static int open_counter(unsigned long long config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+// read the cache-miss and branch-miss counters, leaving them unchanged if unavailable
+static void read_counters(unsigned long long *cache_misses, unsigned long long *branch_misses)
+{
+#ifdef __linux__
+    if (prof.perf_fd == 0)
+    {
+        prof.perf_fd = open_counter(PERF_COUNT_HW_CACHE_MISSES, -1);
+        if ((prof.perf_fd < 0) || (open_counter(PERF_COUNT_HW_BRANCH_MISSES, prof.perf_fd) < 0))
+        {
+            prof.perf_fd = -1;
+        }
+    }
+    // with PERF_FORMAT_GROUP the values are preceded by the number of counters in the group
+    unsigned long long values[3];
+    if ((prof.perf_fd > 0) && (read(prof.perf_fd, values, sizeof(values)) == sizeof(values)))
+    {
+        *cache_misses = values[1];
+        *branch_misses = values[2];
+    }
+#else
+    (void)cache_misses;
+    (void)branch_misses;
+#endif
+}
+
+// start timing a phase
+static void profile_start()
+{
+    read_counters(&prof.start_cache_misses, &prof.start_branch_misses);
+    prof.start_ticks = read_ticks();
+}
+
+// stop timing a phase and add the time and counters to its totals
+static void profile_stop(int phase)
+{
+    unsigned long long stop_ticks = read_ticks();
+    unsigned long long cache_misses = prof.start_cache_misses;
+    unsigned long long branch_misses = prof.start_branch_misses;
+    read_counters(&cache_misses, &branch_misses);
+    prof.calls[phase]++;
+    prof.ticks[phase] += stop_ticks - prof.start_ticks;
+    prof.cache_misses[phase] += cache_misses - prof.start_cache_misses;
+    prof.branch_misses[phase] += branch_misses - prof.start_branch_misses;
+}
+
+// print the time spent in each phase over all puzzles solved so far
+static void print_profile()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "cycles";
+#else
+    const char *unit = "ns";
+#endif
+    unsigned long long total = 0;
+    for (int p = 0; p < NUM_PHASES; p++)
+    {
+        total += prof.ticks[p];
+    }
+    int puzzles = prof.puzzles ? prof.puzzles : 1;
+    fprintf(stderr, "\nProfile over %d puzzles:\n", prof.puzzles);
+    fprintf(stderr, "%-18s %10s %14s %14s %7s %14s %14s\n", "phase", "calls", unit, "per puzzle", "share", "cache misses", "branch misses");
+    for (int p = 0; p < NUM_PHASES; p++)
+    {
+        fprintf(stderr, "%-18s %10llu %14llu %14llu %6.1f%%", phase_names[p], prof.calls[p], prof.ticks[p],
+                prof.ticks[p] / puzzles, total ? (100.0 * prof.ticks[p]) / total : 0.0);
+        if (prof.perf_fd > 0)
+        {
+            fprintf(stderr, " %14llu %14llu\n", prof.cache_misses[p], prof.branch_misses[p]);
+        }
+        else
+        {
+            fprintf(stderr, " %14s %14s\n", "n/a", "n/a");
+        }
+    }
+}
+
+#define PROFILE_START() profile_start()
+#define PROFILE_STOP(phase) profile_stop(phase)
+#else
+#define PROFILE_START()
+#define PROFILE_STOP(phase)
+#endif
 
 // structure representing one of the 81 squares in a sudoku puzzle
 typedef struct Square
@@ -14,8 +190,59 @@ typedef struct Square
     int poss[10];
 } square;
 
+// limits on the rules of a variant puzzle: rows, cols, regions, and diagonals, Killer cages,
+// and squares that can't share a digit with any one square
+#define MAX_UNITS 29
+#define MAX_CAGES 81
+#define MAX_PEERS 48
+
+// header written before the steps for each puzzle in a trace file
+typedef struct Trace_header
+{
+    // original puzzle, whether it was solved, padding, and the count and dropped fields of the trace
+    unsigned char puzzle[81], solved, reserved[2];
+    unsigned int count, dropped;
+} trace_header;
+
+// record a step in the trace, if tracing is enabled and there is room left
+static inline void record_step(trace *log, int kind, int unit, const square *sq, int digit, int digits, int eliminated)
+{
+    if (log == 0)
+    {
+        return;
+    }
+    if (log->count == log->capacity)
+    {
+        log->dropped++;
+        return;
+    }
+    step *s = &log->steps[log->count++];
+    s->kind = (unsigned char)kind;
+    s->unit = (unsigned char)unit;
+    s->square = (unsigned char)((9 * sq->i) + (3 * sq->j) + sq->k);
+    s->digit = (unsigned char)digit;
+    s->digits = (unsigned short)digits;
+    s->eliminated = (unsigned short)eliminated;
+}
+
+// return 1 if a technique should stop early because the trace it is recording to is full and only
+// wants its first few steps, and 0 otherwise
+static inline int stop_tracing(const trace *log)
+{
+    return log && log->stop_when_full && (log->count == log->capacity);
+}
+
+// record possibilities eliminated from a square by a pair or triple, if there were any
+static inline void record_elimination(trace *log, int kind, int unit, const square *sq, int digits, int eliminated)
+{
+    if (eliminated)
+    {
+        record_step(log, kind, unit, sq, 0, digits, eliminated);
+    }
+}
+
 // print the current state of the puzzle
-void print_puzzle(square sudoku[9][3][3])
+void print_puzzle(const board *b)
 {
     for (int i = 0; i < 9; i++)
     {
@@ -25,13 +252,202 @@ void print_puzzle(square sudoku[9][3][3])
         }
         for (int j = 0; j < 3; j++)
         {
-            printf("[%d %d %d] ", sudoku[i][j][0].value, sudoku[i][j][1].value, sudoku[i][j][2].value);
+            const unsigned char *val = &b->value[(9 * i) + (3 * j)];
+            printf("[%d %d %d] ", val[0], val[1], val[2]);
         }
         printf("\n");
     }
     printf("\n");
 }
 
+// print the puzzle as a single line of 81 digits, with a 0 for each undetermined square
+void print_line(const board *b)
+{
+    char line[83];
+    for (int n = 0; n < 81; n++)
+    {
+        line[n] = (char)('0' + b->value[n]);
+    }
+    line[81] = '\n';
+    line[82] = 0;
+    fputs(line, stdout);
+}
+
+// return a description of an error code returned by parse_record
+const char *parse_error_message(int code)
+{
+    switch (code)
+    {
+    case PARSE_OK:
+        return "no error";
+    case PARSE_BAD_LENGTH:
+        return "puzzle must contain exactly 81 characters";
+    case PARSE_BAD_CHAR:
+        return "puzzle must only contain digits, with a 0 or . for each blank space";
+    case PARSE_DUP_ROW:
+        return "digit is repeated in the same row";
+    case PARSE_DUP_COL:
+        return "digit is repeated in the same col";
+    case PARSE_DUP_BOX:
+        return "digit is repeated in the same box";
+    case PARSE_BAD_MARKS:
+        return "candidate marks must be 81 comma-separated lists of the digits 1-9";
+    case PARSE_BAD_RULES:
+        return "variant rules must be x, j= followed by 81 regions, or k= followed by 81 cages and their sums";
+    case PARSE_DUP_UNIT:
+        return "digit is repeated in the same row, col, region, diagonal, or cage";
+    }
+    return "unknown error";
+}
+
+// check that no digit is used twice in the same row, col, or box of a parsed puzzle
+// return PARSE_OK or the error code, and set err_pos to the position of the repeated digit
+int check_contradictions(const board *b, int *err_pos)
+{
+    unsigned short rows[9] = {0};
+    unsigned short cols[9] = {0};
+    unsigned short boxes[9] = {0};
+    for (int n = 0; n < 81; n++)
+    {
+        int val = b->value[n];
+        if (val == 0)
+        {
+            continue;
+        }
+        int row = n / 9;
+        int col = n % 9;
+        int box = (3 * (row / 3)) + (col / 3);
+        unsigned short bit = (unsigned short)(1 << val);
+        int code = PARSE_OK;
+        if (rows[row] & bit)
+        {
+            code = PARSE_DUP_ROW;
+        }
+        else if (cols[col] & bit)
+        {
+            code = PARSE_DUP_COL;
+        }
+        else if (boxes[box] & bit)
+        {
+            code = PARSE_DUP_BOX;
+        }
+        if (code != PARSE_OK)
+        {
+            *err_pos = n;
+            return code;
+        }
+        rows[row] |= bit;
+        cols[col] |= bit;
+        boxes[box] |= bit;
+    }
+    return PARSE_OK;
+}
+
+// convert one character of a puzzle to its value, return -1 if the character is invalid
+static int parse_char(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    if (c == '.')
+    {
+        return 0;
+    }
+    return -1;
+}
+
+// convert a puzzle of len characters (not including any line ending) into b without checking for
+// repeated digits; a 0 or . indicates a blank space; return PARSE_OK if every character is valid,
+// otherwise return the error code and set err_pos to the position (0-80) of the first problem
+int parse_digits(const char *str, int len, board *b, int *err_pos)
+{
+    *err_pos = 0;
+    if (len != 81)
+    {
+        *err_pos = (len < 81) ? len : 81;
+        return PARSE_BAD_LENGTH;
+    }
+    int n = 0;
+#ifdef __SSE2__
+    // validate and convert 16 characters at a time
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i dot_char = _mm_set1_epi8('.');
+    const __m128i below_zero = _mm_set1_epi8(-1);
+    const __m128i above_nine = _mm_set1_epi8(10);
+    for (; n + 16 <= 81; n += 16)
+    {
+        __m128i chars = _mm_loadu_si128((const __m128i *)(str + n));
+        __m128i digits = _mm_sub_epi8(chars, zero_char);
+        __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digits, below_zero), _mm_cmplt_epi8(digits, above_nine));
+        __m128i is_dot = _mm_cmpeq_epi8(chars, dot_char);
+        int valid = _mm_movemask_epi8(_mm_or_si128(is_digit, is_dot));
+        if (valid != 0xFFFF)
+        {
+            *err_pos = n + __builtin_ctz(~valid);
+            return PARSE_BAD_CHAR;
+        }
+        _mm_storeu_si128((__m128i *)(b->value + n), _mm_and_si128(digits, is_digit));
+    }
+#endif
+    for (; n < 81; n++)
+    {
+        int val = parse_char(str[n]);
+        if (val < 0)
+        {
+            *err_pos = n;
+            return PARSE_BAD_CHAR;
+        }
+        b->value[n] = (unsigned char)val;
+    }
+    return PARSE_OK;
+}
+
+// parse a puzzle of len characters (not including any line ending) into b
+// a 0 or . indicates a blank space; return PARSE_OK if the puzzle is valid, otherwise
+// return the error code and set err_pos to the position (0-80) of the first problem
+int parse_record(const char *str, int len, board *b, int *err_pos)
+{
+    int err = parse_digits(str, len, b, err_pos);
+    if (err != PARSE_OK)
+    {
+        return err;
+    }
+    return check_contradictions(b, err_pos);
+}
+
+// parse a player's candidate marks, given as 81 comma-separated lists of digits (one per square, with
+// an empty list for squares that have no marks), into a bitmask for each square with bit d set if d is marked
+// return PARSE_OK if the marks are valid, otherwise return PARSE_BAD_MARKS and set err_pos to the position
+// of the first problem
+int parse_marks(const char *str, int len, unsigned short marks[81], int *err_pos)
+{
+    int n = 0;
+    memset(marks, 0, 81 * sizeof(unsigned short));
+    for (int pos = 0; pos < len; pos++)
+    {
+        if (str[pos] == ',')
+        {
+            n++;
+        }
+        else if ((str[pos] >= '1') && (str[pos] <= '9') && (n < 81))
+        {
+            marks[n] |= (unsigned short)(1 << (str[pos] - '0'));
+        }
+        else
+        {
+            *err_pos = pos;
+            return PARSE_BAD_MARKS;
+        }
+    }
+    if (n != 80)
+    {
+        *err_pos = len;
+        return PARSE_BAD_MARKS;
+    }
+    return PARSE_OK;
+}
+
 // indicate whether specified value val has already been used in the same row, col, or box
 // as the given square unsolved; returns 1 if it has been used and 0 otherwise
 int invalid(square unsolved, int val, int rows[9][10], int cols[9][10], int boxes[9][10])
@@ -69,7 +485,7 @@ void update_square(int i, int j, int k, int val, int rows[9][10], int cols[9][10
 }
 
 // update a given unsolved square, return 0 if still unsolved and 1 if solved
-int update_unsolved(square *unsolved, int rows[9][10], int cols[9][10], int boxes[9][10])
+int update_unsolved(square *unsolved, int rows[9][10], int cols[9][10], int boxes[9][10], trace *log)
 {
     int i = unsolved->i;
     int j = unsolved->j;
@@ -96,6 +512,7 @@ int update_unsolved(square *unsolved, int rows[9][10], int cols[9][10], int boxe
             {
                 unsolved->value = x;
                 update_square(i, j, k, x, rows, cols, boxes);
+                record_step(log, STEP_SINGLE, UNIT_NONE, unsolved, x, 0, 0);
                 return 1;
             }
         }
@@ -157,9 +574,9 @@ void find_unsolved(char dim, int num, square sudoku[9][3][3], square *list_unsol
     }
 }
 
-// check for numbers that only have one possible position in a given row, col, or box
-// and return the number of squares that were solved during the execution of the function
-int check_unique(square *list_unsolved[9], int rows[9][10], int cols[9][10], int boxes[9][10])
+// check for numbers that only have one possible position in a given row, col, or box (numbered as in
+// the trace), and return the number of squares that were solved during the execution of the function
+int check_unique(square *list_unsolved[9], int rows[9][10], int cols[9][10], int boxes[9][10], int unit, trace *log)
 {
     int count = 0;
     // iterate through all digits
@@ -174,8 +591,9 @@ int check_unique(square *list_unsolved[9], int rows[9][10], int cols[9][10], int
             {
                 break;
             }
-            // check if the current square could contain the current digit
-            if (unsolved->poss[x] > 0)
+            // check if the current square could contain the current digit, skipping squares filled in
+            // for an earlier digit (which only happens after a wrong guess)
+            if ((unsolved->value == 0) && (unsolved->poss[x] > 0))
             {
                 if (invalid(*unsolved, x, rows, cols, boxes))
                 {
@@ -200,6 +618,7 @@ int check_unique(square *list_unsolved[9], int rows[9][10], int cols[9][10], int
         {
             loc->value = x;
             update_square(loc->i, loc->j, loc->k, x, rows, cols, boxes);
+            record_step(log, STEP_UNIQUE, unit, loc, x, 0, 0);
             count++;
         }
     }
@@ -207,8 +626,9 @@ int check_unique(square *list_unsolved[9], int rows[9][10], int cols[9][10], int
     return count;
 }
 
-// check for pairs that must go in a certain pair of boxes, return 1 if any pairs found and 0 otherwise
-int check_pairs(square sudoku[9][3][3])
+// check for pairs that must go in a certain pair of boxes, return the number of possibilities eliminated
+// (0 if no pairs found)
+int check_pairs(square sudoku[9][3][3], trace *log)
 {
     int progress_made = 0;
     // check every pair of two distinct digits
@@ -216,6 +636,10 @@ int check_pairs(square sudoku[9][3][3])
     {
         for (int y = 1; y < x; y++)
         {
+            if (stop_tracing(log))
+            {
+                return progress_made;
+            }
             // check for pairs in each row
             for (int i = 0; i < 9; i++)
             {
@@ -250,18 +674,24 @@ int check_pairs(square sudoku[9][3][3])
                 if (count == 2)
                 {
                     // if pair found, neither square can have any other value
+                    unsigned short eliminated[2] = {0};
                     for (int q = 1; q < 10; q++)
                     {
                         for (int w = 0; w < 2; w++)
                         {
                             if ((poss[w]->poss[q] > 0) && (q != x) && (q != y))
                             {
-                                progress_made = 1;
+                                progress_made++;
                                 poss[w]->poss[q] = 0;
                                 poss[w]->poss[0]--;
+                                eliminated[w] |= (unsigned short)(1 << q);
                             }
                         }
                     }
+                    for (int w = 0; w < 2; w++)
+                    {
+                        record_elimination(log, STEP_PAIR, UNIT_ROW + i, poss[w], (1 << x) | (1 << y), eliminated[w]);
+                    }
                     // if pair are both in same box, no other square in that box can have either value
                     if (poss[0]->j == poss[1]->j)
                     {
@@ -275,18 +705,22 @@ int check_pairs(square sudoku[9][3][3])
                                     square *curr_square = &sudoku[i1][j][k];
                                     if (curr_square->value == 0)
                                     {
+                                        unsigned short eliminated = 0;
                                         if (curr_square->poss[x] > 0)
                                         {
                                             curr_square->poss[x] = 0;
                                             curr_square->poss[0]--;
-                                            progress_made = 1;
+                                            eliminated |= (unsigned short)(1 << x);
+                                            progress_made++;
                                         }
                                         if (curr_square->poss[y] > 0)
                                         {
                                             curr_square->poss[y] = 0;
                                             curr_square->poss[0]--;
-                                            progress_made = 1;
+                                            eliminated |= (unsigned short)(1 << y);
+                                            progress_made++;
                                         }
+                                        record_elimination(log, STEP_PAIR, UNIT_ROW + i, curr_square, (1 << x) | (1 << y), eliminated);
                                     }
                                 }
                             }
@@ -324,18 +758,24 @@ int check_pairs(square sudoku[9][3][3])
                     if (count == 2)
                     {
                         // if pair found, neither square can have any other value
+                        unsigned short eliminated[2] = {0};
                         for (int q = 1; q < 10; q++)
                         {
                             for (int w = 0; w < 2; w++)
                             {
                                 if ((poss[w]->poss[q] > 0) && (q != x) && (q != y))
                                 {
-                                    progress_made = 1;
+                                    progress_made++;
                                     poss[w]->poss[q] = 0;
                                     poss[w]->poss[0]--;
+                                    eliminated[w] |= (unsigned short)(1 << q);
                                 }
                             }
                         }
+                        for (int w = 0; w < 2; w++)
+                        {
+                            record_elimination(log, STEP_PAIR, UNIT_COL + (3 * j) + k, poss[w], (1 << x) | (1 << y), eliminated[w]);
+                        }
                         // if pair are both in same box, no other square in that box can have either value
                         if ((poss[0]->i) / 3 == (poss[1]->i) / 3)
                         {
@@ -349,18 +789,22 @@ int check_pairs(square sudoku[9][3][3])
                                         square *curr_square = &sudoku[i1][j][k1];
                                         if (curr_square->value == 0)
                                         {
+                                            unsigned short eliminated = 0;
                                             if (curr_square->poss[x] > 0)
                                             {
                                                 curr_square->poss[x] = 0;
                                                 curr_square->poss[0]--;
-                                                progress_made = 1;
+                                                eliminated |= (unsigned short)(1 << x);
+                                                progress_made++;
                                             }
                                             if (curr_square->poss[y] > 0)
                                             {
                                                 curr_square->poss[y] = 0;
                                                 curr_square->poss[0]--;
-                                                progress_made = 1;
+                                                eliminated |= (unsigned short)(1 << y);
+                                                progress_made++;
                                             }
+                                            record_elimination(log, STEP_PAIR, UNIT_COL + (3 * j) + k, curr_square, (1 << x) | (1 << y), eliminated);
                                         }
                                     }
                                 }
@@ -405,18 +849,24 @@ int check_pairs(square sudoku[9][3][3])
                     if (count == 2)
                     {
                         // if pair found, neither square can have any other value
+                        unsigned short eliminated[2] = {0};
                         for (int q = 1; q < 10; q++)
                         {
                             for (int w = 0; w < 2; w++)
                             {
                                 if ((poss[w]->poss[q] > 0) && (q != x) && (q != y))
                                 {
-                                    progress_made = 1;
+                                    progress_made++;
                                     poss[w]->poss[q] = 0;
                                     poss[w]->poss[0]--;
+                                    eliminated[w] |= (unsigned short)(1 << q);
                                 }
                             }
                         }
+                        for (int w = 0; w < 2; w++)
+                        {
+                            record_elimination(log, STEP_PAIR, UNIT_BOX + (3 * i1) + j, poss[w], (1 << x) | (1 << y), eliminated[w]);
+                        }
                     }
                 }
             }
@@ -425,8 +875,9 @@ int check_pairs(square sudoku[9][3][3])
     return progress_made;
 }
 
-// check for triples that must go in a certain triple of boxes, return 1 if any triples found and 0 otherwise
-int check_triples(square sudoku[9][3][3])
+// check for triples that must go in a certain triple of boxes, return the number of possibilities eliminated
+// (0 if no triples found)
+int check_triples(square sudoku[9][3][3], trace *log)
 {
     int progress_made = 0;
     // check every triple of three distinct digits
@@ -436,6 +887,10 @@ int check_triples(square sudoku[9][3][3])
         {
             for (int z = 1; z < y; z++)
             {
+                if (stop_tracing(log))
+                {
+                    return progress_made;
+                }
                 // check for triples in each row
                 for (int i = 0; i < 9; i++)
                 {
@@ -470,18 +925,24 @@ int check_triples(square sudoku[9][3][3])
                     if (count == 3)
                     {
                         // if triple found, none of the squares can have any other value
+                        unsigned short eliminated[3] = {0};
                         for (int q = 1; q < 10; q++)
                         {
                             for (int w = 0; w < 3; w++)
                             {
                                 if ((poss[w]->poss[q] > 0) && (q != x) && (q != y) && (q != z))
                                 {
-                                    progress_made = 1;
+                                    progress_made++;
                                     poss[w]->poss[q] = 0;
                                     poss[w]->poss[0]--;
+                                    eliminated[w] |= (unsigned short)(1 << q);
                                 }
                             }
                         }
+                        for (int w = 0; w < 3; w++)
+                        {
+                            record_elimination(log, STEP_TRIPLE, UNIT_ROW + i, poss[w], (1 << x) | (1 << y) | (1 << z), eliminated[w]);
+                        }
                         // if triple are all in same box, no other square in that box can have any of the three values
                         int j = poss[0]->j;
                         if ((j == poss[1]->j) && (j == poss[2]->j))
@@ -495,24 +956,29 @@ int check_triples(square sudoku[9][3][3])
                                         square *curr_square = &sudoku[i1][j][k];
                                         if (curr_square->value == 0)
                                         {
+                                            unsigned short eliminated = 0;
                                             if (curr_square->poss[x] > 0)
                                             {
                                                 curr_square->poss[x] = 0;
                                                 curr_square->poss[0]--;
-                                                progress_made = 1;
+                                                eliminated |= (unsigned short)(1 << x);
+                                                progress_made++;
                                             }
                                             if (curr_square->poss[y] > 0)
                                             {
                                                 curr_square->poss[y] = 0;
                                                 curr_square->poss[0]--;
-                                                progress_made = 1;
+                                                eliminated |= (unsigned short)(1 << y);
+                                                progress_made++;
                                             }
                                             if (curr_square->poss[z] > 0)
                                             {
                                                 curr_square->poss[z] = 0;
                                                 curr_square->poss[0]--;
-                                                progress_made = 1;
+                                                eliminated |= (unsigned short)(1 << z);
+                                                progress_made++;
                                             }
+                                            record_elimination(log, STEP_TRIPLE, UNIT_ROW + i, curr_square, (1 << x) | (1 << y) | (1 << z), eliminated);
                                         }
                                     }
                                 }
@@ -550,18 +1016,24 @@ int check_triples(square sudoku[9][3][3])
                         if (count == 3)
                         {
                             // if triple found, none of the three squares can have any other value
+                            unsigned short eliminated[3] = {0};
                             for (int q = 1; q < 10; q++)
                             {
                                 for (int w = 0; w < 3; w++)
                                 {
                                     if ((poss[w]->poss[q] > 0) && (q != x) && (q != y) && (q != z))
                                     {
-                                        progress_made = 1;
+                                        progress_made++;
                                         poss[w]->poss[q] = 0;
                                         poss[w]->poss[0]--;
+                                        eliminated[w] |= (unsigned short)(1 << q);
                                     }
                                 }
                             }
+                            for (int w = 0; w < 3; w++)
+                            {
+                                record_elimination(log, STEP_TRIPLE, UNIT_COL + (3 * j) + k, poss[w], (1 << x) | (1 << y) | (1 << z), eliminated[w]);
+                            }
                             // if triple are all in same box, no other square in that box can have any of the three values
                             int i = poss[0]->i;
                             if ((i / 3 == (poss[1]->i) / 3) && (i / 3 == (poss[2]->i) / 3))
@@ -575,24 +1047,29 @@ int check_triples(square sudoku[9][3][3])
                                             square *curr_square = &sudoku[i1][j][k1];
                                             if (curr_square->value == 0)
                                             {
+                                                unsigned short eliminated = 0;
                                                 if (curr_square->poss[x] > 0)
                                                 {
                                                     curr_square->poss[x] = 0;
                                                     curr_square->poss[0]--;
-                                                    progress_made = 1;
+                                                    eliminated |= (unsigned short)(1 << x);
+                                                    progress_made++;
                                                 }
                                                 if (curr_square->poss[y] > 0)
                                                 {
                                                     curr_square->poss[y] = 0;
                                                     curr_square->poss[0]--;
-                                                    progress_made = 1;
+                                                    eliminated |= (unsigned short)(1 << y);
+                                                    progress_made++;
                                                 }
                                                 if (curr_square->poss[z] > 0)
                                                 {
                                                     curr_square->poss[z] = 0;
                                                     curr_square->poss[0]--;
-                                                    progress_made = 1;
+                                                    eliminated |= (unsigned short)(1 << z);
+                                                    progress_made++;
                                                 }
+                                                record_elimination(log, STEP_TRIPLE, UNIT_COL + (3 * j) + k, curr_square, (1 << x) | (1 << y) | (1 << z), eliminated);
                                             }
                                         }
                                     }
@@ -637,18 +1114,24 @@ int check_triples(square sudoku[9][3][3])
                         if (count == 3)
                         {
                             // if triple found, none of the three squares can have any other value
+                            unsigned short eliminated[3] = {0};
                             for (int q = 1; q < 10; q++)
                             {
                                 for (int w = 0; w < 3; w++)
                                 {
                                     if ((poss[w]->poss[q] > 0) && (q != x) && (q != y) && (q != z))
                                     {
-                                        progress_made = 1;
+                                        progress_made++;
                                         poss[w]->poss[q] = 0;
                                         poss[w]->poss[0]--;
+                                        eliminated[w] |= (unsigned short)(1 << q);
                                     }
                                 }
                             }
+                            for (int w = 0; w < 3; w++)
+                            {
+                                record_elimination(log, STEP_TRIPLE, UNIT_BOX + (3 * i1) + j, poss[w], (1 << x) | (1 << y) | (1 << z), eliminated[w]);
+                            }
                         }
                     }
                 }
@@ -658,115 +1141,397 @@ int check_triples(square sudoku[9][3][3])
     return progress_made;
 }
 
-// solve the puzzle
-void solve_puzzle()
+// fill in the squares of the puzzle and the rows, cols, and boxes lists from a parsed puzzle
+void load_board(const board *b, square sudoku[9][3][3], int rows[9][10], int cols[9][10], int boxes[9][10])
 {
-    char sudoku_str[82] = {0};
-    square sudoku[9][3][3] = {0};
-
-    // get puzzle as user input
-    printf("\nPlease enter a Sudoku puzzle as a string, one row at a time, with a 0 to represent each blank space.\n");
-    printf("Each line must include exactly 9 numeric characters and no other characters.\n\n");
-
-    for (int i = 0; i < 9; i++)
+    for (int n = 0; n < 81; n++)
     {
-        printf("Enter row %d: ", i + 1);
-        scanf("%9s", (sudoku_str + (9 * i)));
-        fflush(stdin);
-        if (strlen(sudoku_str) != (9 * (i + 1)))
+        int i = n / 9;
+        int j = (n % 9) / 3;
+        int k = n % 3;
+        square *curr_square = &sudoku[i][j][k];
+        curr_square->value = b->value[n];
+        curr_square->i = i;
+        curr_square->j = j;
+        curr_square->k = k;
+        if (curr_square->value)
         {
-            printf("\nError: each line must contain exactly 9 characters.\n");
-            return;
-        }
-        for (int j = (9 * i); j < (9 * (i + 1)); j++)
-        {
-            if ((sudoku_str[j] < 48) || (sudoku_str[j] > 57))
-            {
-                printf("\nError: each line must only contain numeric characters.\n");
-                return;
-            }
+            update_square(i, j, k, curr_square->value, rows, cols, boxes);
         }
     }
-    printf("\n");
-
-    // hardcoded example puzzle for testing
-    // strcpy(sudoku_str, "090032040000000000700590306000000053008020400130000000902073008000000000050940060");
-
-    // start timer
-    clock_t start_time = clock();
+}
 
-    // convert input to matrix
-    for (int i = 0; i < 81; i++)
+// copy the values of the squares of the puzzle back into a parsed puzzle
+void store_board(square sudoku[9][3][3], board *b)
+{
+    for (int n = 0; n < 81; n++)
     {
-        int row = i / 9;
-        int col = i % 9;
-        int col1 = col / 3;
-        int col2 = col % 3;
-        sudoku[row][col1][col2].value = (int)sudoku_str[i] - 48;
-        sudoku[row][col1][col2].i = row;
-        sudoku[row][col1][col2].j = col1;
-        sudoku[row][col1][col2].k = col2;
+        b->value[n] = (unsigned char)sudoku[n / 9][(n % 9) / 3][n % 3].value;
     }
+}
 
-    // print original puzzle
-    printf("Original puzzle:");
-    print_puzzle(sudoku);
-
-    // create lists to indicate what has been solved already in each row, column, and box
+// complete state of a puzzle being solved, so that it can be saved before making a guess
+typedef struct State
+{
+    square sudoku[9][3][3];
+    // lists indicating what has been solved already in each row, column, and box
     // within these lists, each nested list indicates a particular row, column, or box in the puzzle
     // the element in position 0 of a nested list counts the number of solved positions within the row/column/box
     // the elements is positions 1-9 of a nested list indicate whether the corresponding number has been placed yet
-    int rows[9][10] = {0};
-    int cols[9][10] = {0};
-    int boxes[9][10] = {0};
+    int rows[9][10], cols[9][10], boxes[9][10];
+} state;
 
-    // fill in rows, cols, and boxes based on original puzzle
-    for (int i = 0; i < 9; i++)
+// return the time in nanoseconds since an arbitrary start, used to measure the cost of each technique and of
+// each puzzle; the clock is monotonic, since a wall clock stepped backwards would make a difference wrap around
+unsigned long long now_ns()
+{
+#ifdef _WIN32
+    // the frequency is read every time rather than cached, since the module calls this from several threads
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    // split the conversion so that the multiplication can't overflow
+    unsigned long long ticks = (unsigned long long)counter.QuadPart;
+    unsigned long long rate = (unsigned long long)frequency.QuadPart;
+    return ((ticks / rate) * 1000000000ULL) + (((ticks % rate) * 1000000000ULL) / rate);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+// initialize the scheduler with the given policy and the original order of techniques
+void init_scheduler(scheduler *sched, int policy)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->policy = policy;
+    for (int t = 0; t < NUM_TECHNIQUES; t++)
     {
-        for (int j = 0; j < 3; j++)
+        sched->order[t] = t;
+        sched->probe_interval[t] = SCHED_PROBE;
+    }
+}
+
+// add the counters collected by another thread's scheduler to the total, leaving the total's
+// policy and the state it uses to choose techniques unchanged
+void merge_scheduler(scheduler *total, const scheduler *sched)
+{
+    for (int t = 0; t < NUM_TECHNIQUES; t++)
+    {
+        total->calls[t] += sched->calls[t];
+        total->eliminations[t] += sched->eliminations[t];
+        total->ns[t] += sched->ns[t];
+    }
+    total->search_calls += sched->search_calls;
+    total->search_eliminations += sched->search_eliminations;
+    total->search_ns += sched->search_ns;
+    total->guesses += sched->guesses;
+}
+
+// return the number of possibilities eliminated per microsecond by a technique, or by guessing if t is -1
+double technique_yield(const scheduler *sched, int t)
+{
+    unsigned long long eliminations = (t < 0) ? sched->search_eliminations : sched->eliminations[t];
+    unsigned long long ns = (t < 0) ? sched->search_ns : sched->ns[t];
+    return (1000.0 * eliminations) / (ns ? ns : 1);
+}
+
+// decide whether a technique should be tried at the given search depth, return 1 if yes and 0 if
+// guessing should be used instead
+int should_run(scheduler *sched, int t, int depth)
+{
+    if (sched->policy == POLICY_GUESS)
+    {
+        return 0;
+    }
+    if (sched->policy != POLICY_ADAPTIVE)
+    {
+        return 1;
+    }
+    // run the technique if there is enough data to show that it eliminates possibilities faster than guessing
+    int trusted = (sched->calls[t] >= SCHED_WARMUP) && (sched->search_calls >= SCHED_WARMUP);
+    if (trusted && (technique_yield(sched, t) >= technique_yield(sched, -1)))
+    {
+        sched->probe_interval[t] = SCHED_PROBE;
+        return 1;
+    }
+    // otherwise only gather data at the top level of each puzzle, not at every node of the search below it:
+    // run the technique until there is enough data to judge it, then retry it every so often in case
+    // the mix of puzzles has changed, waiting longer each time it is still slower
+    if (depth > 0)
+    {
+        return 0;
+    }
+    if (!trusted)
+    {
+        return 1;
+    }
+    sched->skipped[t]++;
+    if (sched->skipped[t] < sched->probe_interval[t])
+    {
+        return 0;
+    }
+    sched->skipped[t] = 0;
+    if (sched->probe_interval[t] < SCHED_MAX_PROBE)
+    {
+        sched->probe_interval[t] *= 2;
+    }
+    return 1;
+}
+
+// sort the techniques so that the one eliminating the most possibilities per microsecond is tried first
+void reorder_techniques(scheduler *sched)
+{
+    if (sched->policy != POLICY_ADAPTIVE)
+    {
+        return;
+    }
+    for (int a = 1; a < NUM_TECHNIQUES; a++)
+    {
+        int t = sched->order[a];
+        int b = a;
+        while ((b > 0) && (technique_yield(sched, sched->order[b - 1]) < technique_yield(sched, t)))
         {
-            for (int k = 0; k < 3; k++)
-            {
-                int val = sudoku[i][j][k].value;
-                if (val)
-                {
-                    update_square(i, j, k, val, rows, cols, boxes);
-                }
-            }
+            sched->order[b] = sched->order[b - 1];
+            b--;
         }
+        sched->order[b] = t;
     }
+}
 
-    // count unsolved squares and update poss for all unsolved squares
-    int count_unsolved = 0;
-    for (int i = 0; i < 9; i++)
+// run a technique and record its cost and yield, return the number of possibilities eliminated
+int run_technique(scheduler *sched, int t, square sudoku[9][3][3], trace *log)
+{
+    unsigned long long start = now_ns();
+    int eliminated = 0;
+    if (t == TECH_PAIRS)
     {
-        for (int j = 0; j < 3; j++)
+        PROFILE_START();
+        eliminated = check_pairs(sudoku, log);
+        PROFILE_STOP(PHASE_PAIRS);
+    }
+    else if (t == TECH_TRIPLES)
+    {
+        PROFILE_START();
+        eliminated = check_triples(sudoku, log);
+        PROFILE_STOP(PHASE_TRIPLES);
+    }
+    sched->ns[t] += now_ns() - start;
+    sched->calls[t]++;
+    sched->eliminations[t] += eliminated;
+    return eliminated;
+}
+
+// apply logical techniques until they stop making progress, return the number of squares left unsolved
+// depth is the number of guesses the search has made so far, which the scheduler uses to decide when to gather data
+int deduce(state *st, int count_unsolved, scheduler *sched, trace *log, int depth)
+{
+    while (count_unsolved)
+    {
+        int prev_count = -1;
+        while (count_unsolved && (count_unsolved != prev_count))
         {
-            for (int k = 0; k < 3; k++)
+            prev_count = count_unsolved;
+            // update possibilities for all unsolved squares
+            PROFILE_START();
+            for (int i = 0; i < 9; i++)
             {
-                if (sudoku[i][j][k].value == 0)
+                for (int j = 0; j < 3; j++)
                 {
-                    // determine which values are possible
-                    int *poss = sudoku[i][j][k].poss;
-                    for (int x = 1; x < 10; x++)
-                    {
-                        if ((rows[i][x] == 0) && (cols[(3 * j) + k][x] == 0) && (boxes[(3 * (i / 3)) + j][x] == 0))
-                        {
-                            poss[x] = 1;
-                            poss[0] += 1;
-                        }
-                    }
-                    // if there is only one possibility, fill in the square's value
-                    if (poss[0] == 1)
+                    for (int k = 0; k < 3; k++)
                     {
-                        for (int x = 1; x < 10; x++)
+                        square *curr_square = &st->sudoku[i][j][k];
+                        if (curr_square->value == 0)
                         {
-                            if (poss[x])
-                            {
-                                sudoku[i][j][k].value = x;
-                                update_square(i, j, k, x, rows, cols, boxes);
-                                break;
-                            }
+                            count_unsolved -= update_unsolved(curr_square, st->rows, st->cols, st->boxes, log);
+                        }
+                    }
+                }
+            }
+            PROFILE_STOP(PHASE_UPDATE);
+            // check for numbers which have only one possible position in any row, col, or box
+            PROFILE_START();
+            for (int num = 0; num < 9; num++)
+            {
+                // check rows
+                square *row_unsolved[9] = {0};
+                find_unsolved('r', num, st->sudoku, row_unsolved);
+                count_unsolved -= check_unique(row_unsolved, st->rows, st->cols, st->boxes, UNIT_ROW + num, log);
+                // check cols
+                square *col_unsolved[9] = {0};
+                find_unsolved('c', num, st->sudoku, col_unsolved);
+                count_unsolved -= check_unique(col_unsolved, st->rows, st->cols, st->boxes, UNIT_COL + num, log);
+                // check boxes
+                square *box_unsolved[9] = {0};
+                find_unsolved('b', num, st->sudoku, box_unsolved);
+                count_unsolved -= check_unique(box_unsolved, st->rows, st->cols, st->boxes, UNIT_BOX + num, log);
+            }
+            PROFILE_STOP(PHASE_UNIQUE);
+        }
+        if (count_unsolved == 0)
+        {
+            break;
+        }
+        // if methods above can't solve puzzle, try the other techniques in the order chosen by the scheduler
+        // and go back to the methods above as soon as one of them makes progress
+        int progress_made = 0;
+        for (int index = 0; (index < NUM_TECHNIQUES) && (progress_made == 0); index++)
+        {
+            int t = sched->order[index];
+            if (should_run(sched, t, depth))
+            {
+                progress_made = run_technique(sched, t, st->sudoku, log);
+            }
+        }
+        if (progress_made == 0)
+        {
+            // none of the techniques made any progress, so the puzzle can't be solved without guessing
+            break;
+        }
+    }
+    return count_unsolved;
+}
+
+// solve the puzzle, guessing whenever logical techniques stop making progress if the policy allows it
+// return the number of squares left unsolved, which is 0 unless the puzzle has no solution
+// or the policy does not allow guessing; if no solution is found, st holds the partial solution
+int search(state *st, int count_unsolved, scheduler *sched, trace *log, int depth)
+{
+    count_unsolved = deduce(st, count_unsolved, sched, log, depth);
+    if ((count_unsolved == 0) || (sched->policy == POLICY_LOGIC))
+    {
+        return count_unsolved;
+    }
+
+    // find the unsolved square with the fewest possibilities, and count the possibilities left
+    PROFILE_START();
+    unsigned long long start = now_ns();
+    square *guess = 0;
+    int remaining = 0;
+    for (int i = 0; i < 9; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                square *curr_square = &st->sudoku[i][j][k];
+                if (curr_square->value == 0)
+                {
+                    remaining += curr_square->poss[0] - 1;
+                    if ((guess == 0) || (curr_square->poss[0] < guess->poss[0]))
+                    {
+                        guess = curr_square;
+                    }
+                }
+            }
+        }
+    }
+    PROFILE_STOP(PHASE_SEARCH);
+    // if some square has no possibilities left, an earlier guess was wrong
+    if ((guess == 0) || (guess->poss[0] < 1))
+    {
+        return count_unsolved;
+    }
+
+    // try each possibility for the square in turn, keeping the first one that leads to a solution
+    int result = count_unsolved;
+    for (int x = 1; (x < 10) && result; x++)
+    {
+        if (guess->poss[x] == 0)
+        {
+            continue;
+        }
+        sched->guesses++;
+        if (sched->max_guesses && (sched->guesses > sched->max_guesses))
+        {
+            break;
+        }
+        PROFILE_START();
+        state *next = malloc(sizeof(state));
+        if (next == 0)
+        {
+            break;
+        }
+        *next = *st;
+        square *curr_square = &next->sudoku[guess->i][guess->j][guess->k];
+        curr_square->value = x;
+        update_square(guess->i, guess->j, guess->k, x, next->rows, next->cols, next->boxes);
+        record_step(log, STEP_GUESS, UNIT_NONE, guess, x, 0, 0);
+        PROFILE_STOP(PHASE_SEARCH);
+        result = search(next, count_unsolved - 1, sched, log, depth + 1);
+        if (result == 0)
+        {
+            *st = *next;
+        }
+        else
+        {
+            record_step(log, STEP_BACKTRACK, UNIT_NONE, guess, x, 0, 0);
+        }
+        free(next);
+    }
+
+    // record how quickly guessing finished off the puzzle so it can be compared with the other techniques
+    if (depth == 0)
+    {
+        sched->search_calls++;
+        sched->search_ns += now_ns() - start;
+        sched->search_eliminations += remaining;
+    }
+    return result ? count_unsolved : 0;
+}
+
+// solve a parsed puzzle in place, return the number of squares that could not be solved
+// if log is not null, the steps taken are recorded in it, replacing any steps from an earlier puzzle
+int solve_board(board *b, scheduler *sched, trace *log)
+{
+    if (log)
+    {
+        log->count = 0;
+        log->dropped = 0;
+    }
+    state *st = calloc(1, sizeof(state));
+    if (st == 0)
+    {
+        return 81;
+    }
+
+    // fill in the squares and the rows, cols, and boxes lists based on original puzzle
+    PROFILE_START();
+    load_board(b, st->sudoku, st->rows, st->cols, st->boxes);
+
+    // count unsolved squares and update poss for all unsolved squares
+    int count_unsolved = 0;
+    for (int i = 0; i < 9; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                if (st->sudoku[i][j][k].value == 0)
+                {
+                    // determine which values are possible
+                    int *poss = st->sudoku[i][j][k].poss;
+                    for (int x = 1; x < 10; x++)
+                    {
+                        if ((st->rows[i][x] == 0) && (st->cols[(3 * j) + k][x] == 0) && (st->boxes[(3 * (i / 3)) + j][x] == 0))
+                        {
+                            poss[x] = 1;
+                            poss[0] += 1;
+                        }
+                    }
+                    // if there is only one possibility, fill in the square's value
+                    if (poss[0] == 1)
+                    {
+                        for (int x = 1; x < 10; x++)
+                        {
+                            if (poss[x])
+                            {
+                                st->sudoku[i][j][k].value = x;
+                                update_square(i, j, k, x, st->rows, st->cols, st->boxes);
+                                record_step(log, STEP_SINGLE, UNIT_NONE, &st->sudoku[i][j][k], x, 0, 0);
+                                break;
+                            }
                         }
                     }
                     // otherwise count the square as unsolved
@@ -778,77 +1543,1855 @@ void solve_puzzle()
             }
         }
     }
+    PROFILE_STOP(PHASE_SETUP);
+
+    // solve the puzzle
+    count_unsolved = search(st, count_unsolved, sched, log, 0);
+    reorder_techniques(sched);
+
+    store_board(st->sudoku, b);
+    free(st);
+#ifdef SUDOKU_PROFILE
+    prof.puzzles++;
+#endif
+    return count_unsolved;
+}
+
+// find the easiest next step for a partially filled puzzle without solving it, trying the techniques
+// in increasing order of cost and stopping at the first one that makes progress
+// marks may be null, or give the player's own candidate marks for each square (bit d set if d is
+// marked), in which case squares with marks are only allowed the marked digits
+// return 1 and fill in hint if a step was found, or 0 if the puzzle can't be progressed without guessing
+int find_hint(const board *b, const unsigned short marks[81], step *hint)
+{
+    state st;
+    memset(&st, 0, sizeof(st));
+    load_board(b, st.sudoku, st.rows, st.cols, st.boxes);
+
+    // find the possibilities for each unsolved square, and return straight away if one has only a single possibility
+    trace first = {hint, 0, 1, 0, 1};
+    square *single = 0;
+    for (int n = 0; n < 81; n++)
+    {
+        int i = n / 9;
+        int j = (n % 9) / 3;
+        int k = n % 3;
+        square *curr_square = &st.sudoku[i][j][k];
+        if (curr_square->value)
+        {
+            continue;
+        }
+        int *poss = curr_square->poss;
+        for (int x = 1; x < 10; x++)
+        {
+            if ((st.rows[i][x] == 0) && (st.cols[(3 * j) + k][x] == 0) && (st.boxes[(3 * (i / 3)) + j][x] == 0) &&
+                ((marks == 0) || (marks[n] == 0) || (marks[n] & (1 << x))))
+            {
+                poss[x] = 1;
+                poss[0]++;
+            }
+        }
+        if ((poss[0] == 1) && (single == 0))
+        {
+            single = curr_square;
+        }
+    }
+    if (single)
+    {
+        return update_unsolved(single, st.rows, st.cols, st.boxes, &first);
+    }
+
+    // check for numbers which have only one possible position in any row, col, or box
+    for (int num = 0; num < 9; num++)
+    {
+        square *row_unsolved[9] = {0};
+        find_unsolved('r', num, st.sudoku, row_unsolved);
+        if (check_unique(row_unsolved, st.rows, st.cols, st.boxes, UNIT_ROW + num, &first))
+        {
+            return 1;
+        }
+        square *col_unsolved[9] = {0};
+        find_unsolved('c', num, st.sudoku, col_unsolved);
+        if (check_unique(col_unsolved, st.rows, st.cols, st.boxes, UNIT_COL + num, &first))
+        {
+            return 1;
+        }
+        square *box_unsolved[9] = {0};
+        find_unsolved('b', num, st.sudoku, box_unsolved);
+        if (check_unique(box_unsolved, st.rows, st.cols, st.boxes, UNIT_BOX + num, &first))
+        {
+            return 1;
+        }
+    }
+
+    // only the first elimination found by the pair and triple checks is kept
+    if (check_pairs(st.sudoku, &first) || check_triples(st.sudoku, &first))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// rules for a variant puzzle, where every all-different group of squares is described by data
+// rather than by the row, col, and box arithmetic used for classic puzzles
+typedef struct Rules
+{
+    // units of 9 squares that must contain every digit exactly once: the 9 rows, the 9 cols,
+    // the 9 boxes or jigsaw regions, and the 2 diagonals for X puzzles
+    int num_units;
+    unsigned char units[MAX_UNITS][9];
+    // Killer cages, whose squares must have different digits adding up to the cage's sum
+    int num_cages;
+    unsigned char cage_size[MAX_CAGES], cage_sum[MAX_CAGES], cage_cells[MAX_CAGES][9];
+    // squares that can't share a digit with each square, filled in by finish_rules
+    unsigned char num_peers[81], peers[81][MAX_PEERS];
+} rules;
+
+// every combination of distinct digits as a bitmask (bit d set if d is used), sorted by number of digits
+// and then by sum, so that combos[combo_start[size][sum]] to combos[combo_start[size][sum + 1]] (or the
+// start of the next size) are the combinations a cage of that size and sum could use
+static unsigned short combos[512];
+static short combo_start[10][47];
+
+// return the number of possibilities in a bitmask of digits
+static int count_poss(unsigned short mask)
+{
+    int count = 0;
+    while (mask)
+    {
+        mask &= (unsigned short)(mask - 1);
+        count++;
+    }
+    return count;
+}
+
+// fill in the table of combinations used to find the possibilities for Killer cages
+void init_cage_table()
+{
+    int count = 0;
+    for (int size = 0; size < 10; size++)
+    {
+        for (int sum = 0; sum < 47; sum++)
+        {
+            combo_start[size][sum] = (short)count;
+            for (int subset = 0; subset < 512; subset++)
+            {
+                int subset_sum = 0;
+                for (int x = 1; x < 10; x++)
+                {
+                    subset_sum += (subset & (1 << (x - 1))) ? x : 0;
+                }
+                if ((count_poss((unsigned short)subset) == size) && (subset_sum == sum))
+                {
+                    combos[count++] = (unsigned short)(subset << 1);
+                }
+            }
+        }
+    }
+}
+
+// set up the rows, cols, and boxes of a classic puzzle
+void classic_rules(rules *r)
+{
+    memset(r, 0, sizeof(*r));
+    for (int num = 0; num < 9; num++)
+    {
+        for (int index = 0; index < 9; index++)
+        {
+            r->units[num][index] = (unsigned char)((9 * num) + index);
+            r->units[9 + num][index] = (unsigned char)((9 * index) + num);
+            r->units[18 + num][index] = (unsigned char)((27 * (num / 3)) + (3 * (num % 3)) + (9 * (index / 3)) + (index % 3));
+        }
+    }
+    r->num_units = 27;
+}
+
+// add a group of squares that can't share a digit to the peers of each of its squares
+static void add_peers(rules *r, const unsigned char *cells, int size)
+{
+    for (int a = 0; a < size; a++)
+    {
+        for (int b = 0; b < size; b++)
+        {
+            int n = cells[a];
+            int already = (a == b);
+            for (int p = 0; (p < r->num_peers[n]) && !already; p++)
+            {
+                already = (r->peers[n][p] == cells[b]);
+            }
+            if (!already)
+            {
+                r->peers[n][r->num_peers[n]++] = cells[b];
+            }
+        }
+    }
+}
+
+// find the peers of every square once the units and cages are complete
+void finish_rules(rules *r)
+{
+    memset(r->num_peers, 0, sizeof(r->num_peers));
+    for (int u = 0; u < r->num_units; u++)
+    {
+        add_peers(r, r->units[u], 9);
+    }
+    for (int c = 0; c < r->num_cages; c++)
+    {
+        add_peers(r, r->cage_cells[c], r->cage_size[c]);
+    }
+}
+
+// parse the rules for a variant puzzle, given as space-separated fields added to the classic rules:
+// "x" adds the two diagonals, "j=" followed by 81 region numbers 1-9 replaces the boxes with jigsaw regions,
+// and "k=" followed by 81 cage letters (A-Z or a-z, or . for squares in no cage), a colon, and the cage sums
+// separated by commas (in the order each cage first appears) adds Killer cages
+// return PARSE_OK if the rules are valid, otherwise return PARSE_BAD_RULES and set err_pos to the position
+// of the first problem
+int parse_rules(const char *str, int len, rules *r, int *err_pos)
+{
+    classic_rules(r);
+    int pos = 0;
+    while (pos < len)
+    {
+        int field_len = 0;
+        while ((pos + field_len < len) && (str[pos + field_len] != ' '))
+        {
+            field_len++;
+        }
+        const char *field = str + pos;
+        *err_pos = pos;
+        if ((field_len == 1) && (field[0] == 'x') && (r->num_units == 27))
+        {
+            // add the diagonals
+            for (int index = 0; index < 9; index++)
+            {
+                r->units[27][index] = (unsigned char)(10 * index);
+                r->units[28][index] = (unsigned char)((9 * index) + (8 - index));
+            }
+            r->num_units = 29;
+        }
+        else if ((field_len == 83) && (strncmp(field, "j=", 2) == 0))
+        {
+            // replace the boxes with the jigsaw regions, each of which must have exactly 9 squares
+            int sizes[9] = {0};
+            for (int n = 0; n < 81; n++)
+            {
+                int region = field[2 + n] - '1';
+                if ((region < 0) || (region > 8) || (sizes[region] == 9))
+                {
+                    *err_pos = pos + 2 + n;
+                    return PARSE_BAD_RULES;
+                }
+                r->units[18 + region][sizes[region]++] = (unsigned char)n;
+            }
+        }
+        else if ((field_len > 84) && (strncmp(field, "k=", 2) == 0) && (field[83] == ':') && (r->num_cages == 0))
+        {
+            // number the cages in the order they first appear
+            int cage_of[128];
+            for (int c = 0; c < 128; c++)
+            {
+                cage_of[c] = -1;
+            }
+            for (int n = 0; n < 81; n++)
+            {
+                char id = field[2 + n];
+                if (id == '.')
+                {
+                    continue;
+                }
+                if (!(((id >= 'A') && (id <= 'Z')) || ((id >= 'a') && (id <= 'z'))))
+                {
+                    *err_pos = pos + 2 + n;
+                    return PARSE_BAD_RULES;
+                }
+                if (cage_of[(int)id] < 0)
+                {
+                    cage_of[(int)id] = r->num_cages++;
+                }
+                int c = cage_of[(int)id];
+                if (r->cage_size[c] == 9)
+                {
+                    *err_pos = pos + 2 + n;
+                    return PARSE_BAD_RULES;
+                }
+                r->cage_cells[c][r->cage_size[c]++] = (unsigned char)n;
+            }
+            // read the sums, each of which must be possible for a cage of that size
+            int c = 0;
+            int sum_pos = 84;
+            while ((sum_pos < field_len) && (c < r->num_cages))
+            {
+                int sum = 0;
+                int digits = 0;
+                while ((sum_pos < field_len) && (field[sum_pos] >= '0') && (field[sum_pos] <= '9') && (digits < 2))
+                {
+                    sum = (10 * sum) + (field[sum_pos++] - '0');
+                    digits++;
+                }
+                int size = r->cage_size[c];
+                if ((digits == 0) || (sum > 45) || (combo_start[size][sum] == combo_start[size][sum + 1]))
+                {
+                    *err_pos = pos + sum_pos;
+                    return PARSE_BAD_RULES;
+                }
+                r->cage_sum[c++] = (unsigned char)sum;
+                if ((sum_pos < field_len) && (field[sum_pos] == ','))
+                {
+                    sum_pos++;
+                }
+            }
+            if ((c != r->num_cages) || (sum_pos != field_len))
+            {
+                *err_pos = pos + sum_pos;
+                return PARSE_BAD_RULES;
+            }
+        }
+        else if (field_len > 0)
+        {
+            return PARSE_BAD_RULES;
+        }
+        pos += field_len + 1;
+    }
+    finish_rules(r);
+    return PARSE_OK;
+}
+
+// check that no digit is used twice in the same unit or cage of a variant puzzle
+// return PARSE_OK or PARSE_DUP_UNIT, and set err_pos to the position of the repeated digit
+int check_rules(const board *b, const rules *r, int *err_pos)
+{
+    for (int n = 0; n < 81; n++)
+    {
+        for (int p = 0; p < r->num_peers[n]; p++)
+        {
+            int peer = r->peers[n][p];
+            if (b->value[n] && (b->value[n] == b->value[peer]))
+            {
+                *err_pos = (n > peer) ? n : peer;
+                return PARSE_DUP_UNIT;
+            }
+        }
+    }
+    return PARSE_OK;
+}
+
+// remove possibilities that break the rules from a variant puzzle, where poss[n] has bit d set if square n
+// could be d, until no more can be removed; return 0 if some square has no possibilities left and 1 otherwise
+DISPATCH int propagate(const rules *r, unsigned short poss[81])
+{
+    int progress_made = 1;
+    while (progress_made)
+    {
+        progress_made = 0;
+        // remove the value of each solved square from the possibilities of its peers
+        for (int n = 0; n < 81; n++)
+        {
+            if (count_poss(poss[n]) != 1)
+            {
+                continue;
+            }
+            for (int p = 0; p < r->num_peers[n]; p++)
+            {
+                int peer = r->peers[n][p];
+                if (poss[peer] & poss[n])
+                {
+                    poss[peer] &= (unsigned short)~poss[n];
+                    if (poss[peer] == 0)
+                    {
+                        return 0;
+                    }
+                    progress_made = 1;
+                }
+            }
+        }
+        // fill in digits that only have one possible position in a unit
+        for (int u = 0; u < r->num_units; u++)
+        {
+            unsigned short once = 0;
+            unsigned short twice = 0;
+            for (int index = 0; index < 9; index++)
+            {
+                unsigned short curr = poss[r->units[u][index]];
+                twice |= once & curr;
+                once |= curr;
+            }
+            if (once != 0x3FE)
+            {
+                return 0;
+            }
+            unsigned short unique = once & (unsigned short)~twice;
+            for (int index = 0; unique && (index < 9); index++)
+            {
+                unsigned short *curr = &poss[r->units[u][index]];
+                if ((*curr & unique) && (*curr != (*curr & unique)))
+                {
+                    *curr &= unique;
+                    if (count_poss(*curr) != 1)
+                    {
+                        return 0;
+                    }
+                    progress_made = 1;
+                }
+            }
+        }
+        // keep only the digits of each cage that appear in some combination with the right sum
+        // that uses every digit already placed in the cage
+        for (int c = 0; c < r->num_cages; c++)
+        {
+            unsigned short placed = 0;
+            unsigned short avail = 0;
+            for (int index = 0; index < r->cage_size[c]; index++)
+            {
+                unsigned short curr = poss[r->cage_cells[c][index]];
+                placed |= (count_poss(curr) == 1) ? curr : 0;
+                avail |= curr;
+            }
+            int size = r->cage_size[c];
+            int sum = r->cage_sum[c];
+            unsigned short allowed = 0;
+            for (int index = combo_start[size][sum]; index < combo_start[size][sum + 1]; index++)
+            {
+                if (((combos[index] & placed) == placed) && ((combos[index] & avail) == combos[index]))
+                {
+                    allowed |= combos[index];
+                }
+            }
+            for (int index = 0; index < r->cage_size[c]; index++)
+            {
+                unsigned short *curr = &poss[r->cage_cells[c][index]];
+                if (*curr & (unsigned short)~allowed)
+                {
+                    *curr &= allowed;
+                    if (*curr == 0)
+                    {
+                        return 0;
+                    }
+                    progress_made = 1;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+// solve a variant puzzle by propagating the rules and guessing when that stops making progress
+// return 1 and leave the solution in poss if a solution is found, and 0 otherwise
+DISPATCH int variant_search(const rules *r, unsigned short poss[81])
+{
+    if (propagate(r, poss) == 0)
+    {
+        return 0;
+    }
+    // guess a value for the unsolved square with the fewest possibilities
+    int guess = -1;
+    int fewest = 10;
+    for (int n = 0; n < 81; n++)
+    {
+        int count = count_poss(poss[n]);
+        if ((count > 1) && (count < fewest))
+        {
+            guess = n;
+            fewest = count;
+        }
+    }
+    if (guess < 0)
+    {
+        return 1;
+    }
+    for (int x = 1; x < 10; x++)
+    {
+        if (poss[guess] & (1 << x))
+        {
+            unsigned short next[81];
+            memcpy(next, poss, sizeof(next));
+            next[guess] = (unsigned short)(1 << x);
+            if (variant_search(r, next))
+            {
+                memcpy(poss, next, sizeof(next));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// solve a parsed variant puzzle in place, return the number of squares that could not be solved
+int solve_variant(board *b, const rules *r)
+{
+    unsigned short poss[81];
+    for (int n = 0; n < 81; n++)
+    {
+        poss[n] = b->value[n] ? (unsigned short)(1 << b->value[n]) : 0x3FE;
+    }
+    if (variant_search(r, poss) == 0)
+    {
+        return 81;
+    }
+    for (int n = 0; n < 81; n++)
+    {
+        for (int x = 1; x < 10; x++)
+        {
+            if (poss[n] == (1 << x))
+            {
+                b->value[n] = (unsigned char)x;
+            }
+        }
+    }
+    return 0;
+}
+
+// count the solutions of a variant puzzle, stopping once limit solutions have been found
+DISPATCH int count_solutions(const rules *r, const unsigned short poss[81], int limit)
+{
+    unsigned short curr[81];
+    memcpy(curr, poss, sizeof(curr));
+    if (propagate(r, curr) == 0)
+    {
+        return 0;
+    }
+    int guess = -1;
+    int fewest = 10;
+    for (int n = 0; n < 81; n++)
+    {
+        int count = count_poss(curr[n]);
+        if ((count > 1) && (count < fewest))
+        {
+            guess = n;
+            fewest = count;
+        }
+    }
+    if (guess < 0)
+    {
+        return 1;
+    }
+    int found = 0;
+    for (int x = 1; (x < 10) && (found < limit); x++)
+    {
+        if (curr[guess] & (1 << x))
+        {
+            unsigned short next[81];
+            memcpy(next, curr, sizeof(next));
+            next[guess] = (unsigned short)(1 << x);
+            found += count_solutions(r, next, limit - found);
+        }
+    }
+    return found;
+}
+
+// read a whole file into memory, return the contents (which must be freed) or null on error
+char *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == 0)
+    {
+        fprintf(stderr, "Error: unable to open %s\n", path);
+        return 0;
+    }
+    size_t capacity = 1 << 16;
+    char *data = malloc(capacity);
+    size_t got;
+    *size = 0;
+    while (data && ((got = fread(data + *size, 1, capacity - *size, file)) > 0))
+    {
+        *size += got;
+        if (*size == capacity)
+        {
+            capacity *= 2;
+            char *grown = realloc(data, capacity);
+            if (grown == 0)
+            {
+                free(data);
+            }
+            data = grown;
+        }
+    }
+    fclose(file);
+    if (data == 0)
+    {
+        fprintf(stderr, "Error: out of memory reading %s\n", path);
+    }
+    return data;
+}
+
+// return the next line that isn't blank in a file read into memory, starting at *curr and stopping before end,
+// set len to its length without the \n or \r\n ending, and advance *curr and line_num past it
+// return null when there are no lines left
+const char *next_line(const char **curr, const char *end, int *len, int *line_num)
+{
+    while (*curr < end)
+    {
+        const char *line = *curr;
+        const char *newline = memchr(line, '\n', (size_t)(end - line));
+        const char *line_end = newline ? newline : end;
+        *curr = line_end + 1;
+        *len = (int)(line_end - line);
+        (*line_num)++;
+        // accept both \n and \r\n line endings
+        if ((*len > 0) && (line[*len - 1] == '\r'))
+        {
+            (*len)--;
+        }
+        if (*len > 0)
+        {
+            return line;
+        }
+    }
+    return 0;
+}
+
+// write the original puzzle and the steps taken to solve it to a trace file
+void write_trace(FILE *file, const board *original, int solved, const trace *log)
+{
+    trace_header header = {0};
+    memcpy(header.puzzle, original->value, 81);
+    header.solved = (unsigned char)solved;
+    header.count = log->count;
+    header.dropped = log->dropped;
+    fwrite(&header, sizeof(header), 1, file);
+    // a variant puzzle's trace has no steps and may have no buffer, which fwrite must not be given
+    if (log->count)
+    {
+        fwrite(log->steps, sizeof(step), log->count, file);
+    }
+}
+
+// print the digits whose bits are set in mask, separated by commas
+static void print_digits(FILE *out, int mask)
+{
+    int first = 1;
+    for (int x = 1; x < 10; x++)
+    {
+        if (mask & (1 << x))
+        {
+            fprintf(out, first ? "%d" : ",%d", x);
+            first = 0;
+        }
+    }
+}
+
+// print the name of a unit, such as "row 3", using 1-indexing
+static void print_unit(FILE *out, int unit)
+{
+    if (unit < UNIT_COL)
+    {
+        fprintf(out, "row %d", unit - UNIT_ROW + 1);
+    }
+    else if (unit < UNIT_BOX)
+    {
+        fprintf(out, "col %d", unit - UNIT_COL + 1);
+    }
+    else
+    {
+        fprintf(out, "box %d", unit - UNIT_BOX + 1);
+    }
+}
+
+// print one step of a trace as a line of text, using 1-indexing for rows and cols
+void print_step_text(FILE *out, const step *s)
+{
+    int row = (s->square / 9) + 1;
+    int col = (s->square % 9) + 1;
+    switch (s->kind)
+    {
+    case STEP_SINGLE:
+        fprintf(out, "row %d, col %d = %d (only possibility left)\n", row, col, s->digit);
+        break;
+    case STEP_UNIQUE:
+        fprintf(out, "row %d, col %d = %d (only place for %d in ", row, col, s->digit, s->digit);
+        print_unit(out, s->unit);
+        fprintf(out, ")\n");
+        break;
+    case STEP_PAIR:
+    case STEP_TRIPLE:
+        fprintf(out, "%s ", (s->kind == STEP_PAIR) ? "pair" : "triple");
+        print_digits(out, s->digits);
+        fprintf(out, " in ");
+        print_unit(out, s->unit);
+        fprintf(out, ": row %d, col %d cannot be ", row, col);
+        print_digits(out, s->eliminated);
+        fprintf(out, "\n");
+        break;
+    case STEP_GUESS:
+        fprintf(out, "guess row %d, col %d = %d\n", row, col, s->digit);
+        break;
+    case STEP_BACKTRACK:
+        fprintf(out, "backtrack: row %d, col %d cannot be %d\n", row, col, s->digit);
+        break;
+    }
+}
+
+// print one step of a trace as a JSON object, using 1-indexing for rows and cols
+void print_step_json(FILE *out, const step *s)
+{
+    static const char *kind_names[] = {"single", "unique", "pair", "triple", "guess", "backtrack"};
+    fprintf(out, "{\"kind\":\"%s\",\"row\":%d,\"col\":%d", kind_names[s->kind], (s->square / 9) + 1, (s->square % 9) + 1);
+    if (s->unit != UNIT_NONE)
+    {
+        fprintf(out, ",\"unit\":\"");
+        print_unit(out, s->unit);
+        fprintf(out, "\"");
+    }
+    if (s->digit)
+    {
+        fprintf(out, ",\"digit\":%d", s->digit);
+    }
+    if (s->digits)
+    {
+        fprintf(out, ",\"digits\":[");
+        print_digits(out, s->digits);
+        fprintf(out, "]");
+    }
+    if (s->eliminated)
+    {
+        fprintf(out, ",\"eliminated\":[");
+        print_digits(out, s->eliminated);
+        fprintf(out, "]");
+    }
+    fprintf(out, "}");
+}
+
+// return 1 if a step read from a trace file could have been written by the solver, and 0 if not,
+// so that a corrupt or foreign file can't index past the names of kinds and units
+static int valid_step(const step *s)
+{
+    return (s->kind <= STEP_BACKTRACK) && ((s->unit < UNIT_BOX + 9) || (s->unit == UNIT_NONE)) && (s->square < 81);
+}
+
+// print every puzzle in a trace file with the steps taken to solve it, either as text or
+// as one JSON object per line; return 0 if the file was decoded and 1 otherwise
+int decode_trace(const char *path, int json)
+{
+    size_t size;
+    char *data = read_file(path, &size);
+    if (data == 0)
+    {
+        return 1;
+    }
+    size_t pos = 0;
+    int valid = 1;
+    while (valid && (pos + sizeof(trace_header) <= size))
+    {
+        trace_header header;
+        memcpy(&header, data + pos, sizeof(header));
+        pos += sizeof(header);
+        if ((size - pos) / sizeof(step) < header.count)
+        {
+            break;
+        }
+        // check every step of the puzzle before printing any of it
+        for (unsigned int index = 0; index < header.count; index++)
+        {
+            step s;
+            memcpy(&s, data + pos + (index * sizeof(s)), sizeof(s));
+            valid &= valid_step(&s);
+        }
+        if (!valid)
+        {
+            break;
+        }
+        board puzzle;
+        memcpy(puzzle.value, header.puzzle, 81);
+        if (json)
+        {
+            printf("{\"puzzle\":\"");
+            for (int n = 0; n < 81; n++)
+            {
+                putchar('0' + puzzle.value[n]);
+            }
+            printf("\",\"solved\":%s,\"dropped\":%u,\"steps\":[", header.solved ? "true" : "false", header.dropped);
+        }
+        else
+        {
+            print_line(&puzzle);
+        }
+        for (unsigned int index = 0; index < header.count; index++)
+        {
+            step s;
+            memcpy(&s, data + pos, sizeof(s));
+            pos += sizeof(s);
+            if (json)
+            {
+                if (index)
+                {
+                    putchar(',');
+                }
+                print_step_json(stdout, &s);
+            }
+            else
+            {
+                print_step_text(stdout, &s);
+            }
+        }
+        if (json)
+        {
+            printf("]}\n");
+        }
+        else
+        {
+            if (header.dropped)
+            {
+                printf("(%u more steps did not fit in the trace)\n", header.dropped);
+            }
+            printf("%s\n\n", header.solved ? "solved" : "unable to solve");
+        }
+    }
+    free(data);
+    if (!valid)
+    {
+        fprintf(stderr, "Error: %s is not a valid trace file\n", path);
+        return 1;
+    }
+    if (pos != size)
+    {
+        fprintf(stderr, "Error: %s is not a complete trace file\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// get a puzzle as user input and solve it, writing the steps taken to trace_file if it is not null
+void solve_puzzle(scheduler *sched, trace *log, FILE *trace_file)
+{
+    char sudoku_str[82] = {0};
+    board puzzle;
+
+    // get puzzle as user input
+    printf("\nPlease enter a Sudoku puzzle as a string, one row at a time, with a 0 or . to represent each blank space.\n");
+    printf("Each line must include exactly 9 characters and no other characters.\n\n");
+
+    for (int i = 0; i < 9; i++)
+    {
+        printf("Enter row %d: ", i + 1);
+        scanf("%9s", (sudoku_str + (9 * i)));
+        fflush(stdin);
+        if (strlen(sudoku_str) != (9 * (i + 1)))
+        {
+            printf("\nError: each line must contain exactly 9 characters.\n");
+            return;
+        }
+    }
+    printf("\n");
+
+    // hardcoded example puzzle for testing
+    // strcpy(sudoku_str, "090032040000000000700590306000000053008020400130000000902073008000000000050940060");
+
+    // start timer
+    clock_t start_time = clock();
+
+    // validate input and convert it to a board
+    int err_pos;
+    int err = parse_record(sudoku_str, 81, &puzzle, &err_pos);
+    if (err != PARSE_OK)
+    {
+        printf("Error in row %d, col %d: %s.\n", (err_pos / 9) + 1, (err_pos % 9) + 1, parse_error_message(err));
+        return;
+    }
+
+    // print original puzzle
+    printf("Original puzzle:");
+    print_puzzle(&puzzle);
+
+    // print solution
+    board original = puzzle;
+    int count_unsolved = solve_board(&puzzle, sched, log);
+    if (count_unsolved)
+    {
+        printf("Unable to solve puzzle. Partial solution:");
+    }
+    else
+    {
+        printf("Solution:");
+    }
+    print_puzzle(&puzzle);
+    if (trace_file)
+    {
+        write_trace(trace_file, &original, count_unsolved == 0, log);
+    }
+
+    // stop timer and print time
+    clock_t stop_time = clock();
+    printf("Execution time: %f seconds\n\n", (double)(stop_time - start_time) / CLOCKS_PER_SEC);
+#ifdef SUDOKU_PROFILE
+    print_profile();
+#endif
+}
+
+// print the measured cost and yield of each technique, in the order the scheduler is using them
+void print_scheduler(const scheduler *sched)
+{
+    static const char *technique_names[NUM_TECHNIQUES] = {"check_pairs", "check_triples"};
+    for (int index = 0; index < NUM_TECHNIQUES; index++)
+    {
+        int t = sched->order[index];
+        fprintf(stderr, "%s: %llu calls, %llu eliminated, %.3f per microsecond\n", technique_names[t],
+                sched->calls[t], sched->eliminations[t], technique_yield(sched, t));
+    }
+    fprintf(stderr, "guessing: %llu puzzles, %llu eliminated, %.3f per microsecond\n",
+            sched->search_calls, sched->search_eliminations, technique_yield(sched, -1));
+}
+
+// return the histogram bucket for a latency in nanoseconds, keeping its top 5 bits
+static int latency_bucket(unsigned long long ns)
+{
+#if defined(__GNUC__)
+    int msb = 63 - __builtin_clzll(ns | 1);
+    int shift = (msb > LATENCY_SUB_BITS) ? (msb - LATENCY_SUB_BITS) : 0;
+#else
+    int shift = 0;
+    while ((ns >> shift) >= (2ULL << LATENCY_SUB_BITS))
+    {
+        shift++;
+    }
+#endif
+    return (shift << LATENCY_SUB_BITS) + (int)(ns >> shift);
+}
+
+// return the smallest latency in nanoseconds recorded in the given bucket
+static unsigned long long bucket_start(int bucket)
+{
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    if (shift <= 0)
+    {
+        return (unsigned long long)bucket;
+    }
+    return (unsigned long long)(bucket - (shift << LATENCY_SUB_BITS)) << shift;
+}
+
+// count one puzzle, solved or not, that took the given number of nanoseconds
+void record_puzzle(metrics *m, unsigned long long ns, int solved)
+{
+    if (solved)
+    {
+        m->solved++;
+    }
+    else
+    {
+        m->unsolved++;
+    }
+    m->latency[latency_bucket(ns)]++;
+    m->latency_ns += ns;
+    if (ns > m->max_ns)
+    {
+        m->max_ns = ns;
+    }
+}
+
+// add the counts collected by another thread to the total
+void merge_metrics(metrics *total, const metrics *m)
+{
+    total->solved += m->solved;
+    total->unsolved += m->unsolved;
+    total->invalid += m->invalid;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        total->latency[bucket] += m->latency[bucket];
+    }
+    total->latency_ns += m->latency_ns;
+    if (m->max_ns > total->max_ns)
+    {
+        total->max_ns = m->max_ns;
+    }
+}
+
+// return the latency in nanoseconds that the given fraction of puzzles were solved within,
+// rounded up to the end of its bucket, or 0 if no puzzles have been recorded
+unsigned long long latency_quantile(const metrics *m, double q)
+{
+    unsigned long long count = m->solved + m->unsolved;
+    unsigned long long rank = (unsigned long long)(q * (double)count);
+    if ((double)rank < q * (double)count)
+    {
+        rank++;
+    }
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    unsigned long long seen = 0;
+    for (int bucket = 0; (bucket < LATENCY_BUCKETS) && count; bucket++)
+    {
+        seen += m->latency[bucket];
+        if (seen >= rank)
+        {
+            unsigned long long end = (bucket + 1 < LATENCY_BUCKETS) ? (bucket_start(bucket + 1) - 1) : m->max_ns;
+            return (end < m->max_ns) ? end : m->max_ns;
+        }
+    }
+    return 0;
+}
+
+// write the metrics and the scheduler's counters in the Prometheus text format, for a collector
+// that scrapes the file (such as the node exporter's textfile collector)
+// the file is written under a temporary name and renamed, so a reader never sees it half written
+// return 0 on success and 1 if the file could not be written
+int write_metrics(const char *path, const metrics *m, const scheduler *sched)
+{
+    static const char *technique_names[NUM_TECHNIQUES] = {"check_pairs", "check_triples"};
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    char temp_path[4096];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.tmp", path) >= (int)sizeof(temp_path))
+    {
+        return 1;
+    }
+    FILE *file = fopen(temp_path, "w");
+    if (file == 0)
+    {
+        return 1;
+    }
+
+    fprintf(file, "# HELP sudoku_puzzles_total Puzzles read, by result.\n");
+    fprintf(file, "# TYPE sudoku_puzzles_total counter\n");
+    fprintf(file, "sudoku_puzzles_total{result=\"solved\"} %llu\n", m->solved);
+    fprintf(file, "sudoku_puzzles_total{result=\"unsolved\"} %llu\n", m->unsolved);
+    fprintf(file, "sudoku_puzzles_total{result=\"invalid\"} %llu\n", m->invalid);
+    fprintf(file, "# HELP sudoku_guesses_total Guesses made while searching.\n");
+    fprintf(file, "# TYPE sudoku_guesses_total counter\n");
+    fprintf(file, "sudoku_guesses_total %llu\n", sched->guesses);
+
+    // guessing is reported as one more technique where its calls and eliminations can be compared with the others,
+    // but its time covers the whole search below the first guess, including techniques run inside it,
+    // so it is reported separately instead of being added to the time spent in techniques
+    fprintf(file, "# HELP sudoku_technique_seconds_total Time spent in each technique.\n");
+    fprintf(file, "# TYPE sudoku_technique_seconds_total counter\n");
+    for (int t = 0; t < NUM_TECHNIQUES; t++)
+    {
+        fprintf(file, "sudoku_technique_seconds_total{technique=\"%s\"} %.9f\n", technique_names[t], sched->ns[t] / 1e9);
+    }
+    fprintf(file, "# HELP sudoku_search_subtree_seconds_total Time spent searching after the first guess, including techniques run while searching.\n");
+    fprintf(file, "# TYPE sudoku_search_subtree_seconds_total counter\n");
+    fprintf(file, "sudoku_search_subtree_seconds_total %.9f\n", sched->search_ns / 1e9);
+    fprintf(file, "# HELP sudoku_technique_calls_total Calls to each technique.\n");
+    fprintf(file, "# TYPE sudoku_technique_calls_total counter\n");
+    for (int t = 0; t < NUM_TECHNIQUES; t++)
+    {
+        fprintf(file, "sudoku_technique_calls_total{technique=\"%s\"} %llu\n", technique_names[t], sched->calls[t]);
+    }
+    fprintf(file, "sudoku_technique_calls_total{technique=\"guessing\"} %llu\n", sched->search_calls);
+    fprintf(file, "# HELP sudoku_technique_eliminations_total Possibilities eliminated by each technique.\n");
+    fprintf(file, "# TYPE sudoku_technique_eliminations_total counter\n");
+    for (int t = 0; t < NUM_TECHNIQUES; t++)
+    {
+        fprintf(file, "sudoku_technique_eliminations_total{technique=\"%s\"} %llu\n", technique_names[t], sched->eliminations[t]);
+    }
+    fprintf(file, "sudoku_technique_eliminations_total{technique=\"guessing\"} %llu\n", sched->search_eliminations);
+
+    // the exported buckets are powers of two from about a microsecond to about a second, which fall on
+    // bucket boundaries of the histogram, so their counts are exact
+    fprintf(file, "# HELP sudoku_solve_duration_seconds Time to solve each puzzle.\n");
+    fprintf(file, "# TYPE sudoku_solve_duration_seconds histogram\n");
+    unsigned long long seen = 0;
+    int bucket = 0;
+    for (int power = 10; power <= 30; power++)
+    {
+        unsigned long long limit = 1ULL << power;
+        while (bucket_start(bucket) < limit)
+        {
+            seen += m->latency[bucket];
+            bucket++;
+        }
+        fprintf(file, "sudoku_solve_duration_seconds_bucket{le=\"%.10g\"} %llu\n", limit / 1e9, seen);
+    }
+    fprintf(file, "sudoku_solve_duration_seconds_bucket{le=\"+Inf\"} %llu\n", m->solved + m->unsolved);
+    fprintf(file, "sudoku_solve_duration_seconds_sum %.9f\n", m->latency_ns / 1e9);
+    fprintf(file, "sudoku_solve_duration_seconds_count %llu\n", m->solved + m->unsolved);
+    fprintf(file, "# HELP sudoku_solve_duration_quantile_seconds Time that a fraction of puzzles were solved within.\n");
+    fprintf(file, "# TYPE sudoku_solve_duration_quantile_seconds gauge\n");
+    for (int q = 0; q < 4; q++)
+    {
+        fprintf(file, "sudoku_solve_duration_quantile_seconds{quantile=\"%g\"} %.9f\n", quantiles[q], latency_quantile(m, quantiles[q]) / 1e9);
+    }
+    fprintf(file, "sudoku_solve_duration_quantile_seconds{quantile=\"1\"} %.9f\n", m->max_ns / 1e9);
+
+    int failed = ferror(file);
+    failed |= fclose(file);
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows
+    remove(path);
+#endif
+    if (failed || rename(temp_path, path))
+    {
+        remove(temp_path);
+        return 1;
+    }
+    return 0;
+}
+
+// solve every puzzle in a file containing one 81-character puzzle per line, printing one line per puzzle;
+// unsolvable puzzles are printed as a partial solution and invalid lines are reported and skipped
+// a puzzle may be followed by a space and the rules of a variant, in the format read by parse_rules
+// if trace_file is not null, the steps taken for each puzzle are written to it, and if metrics_path is not null,
+// the metrics are rewritten to it every METRICS_INTERVAL_NS nanoseconds and when the file is finished
+// return 0 if every puzzle was read and solved and 1 otherwise
+int solve_file(const char *path, scheduler *sched, trace *log, FILE *trace_file, const char *metrics_path)
+{
+    // read the whole file at once so records can be parsed directly from memory
+    size_t size;
+    char *data = read_file(path, &size);
+    if (data == 0)
+    {
+        return 1;
+    }
+
+    clock_t start_time = clock();
+    int line_num = 0;
+    metrics stats;
+    memset(&stats, 0, sizeof(stats));
+    unsigned long long written_ns = now_ns();
+    const char *curr = data;
+    const char *end = data + size;
+    const char *line;
+    int len;
+    while ((line = next_line(&curr, end, &len, &line_num)) != 0)
+    {
+        board puzzle;
+        int err_pos;
+        int err;
+        // a puzzle followed by variant rules is solved with the rules engine, and classic puzzles use the
+        // classic solver, which is the one that follows the scheduler's policy and records traces
+        // (it is not faster: the rules engine has about the same throughput on classic puzzles and a shorter tail)
+        if ((len > 81) && (line[81] == ' '))
+        {
+            rules r;
+            err = parse_digits(line, 81, &puzzle, &err_pos);
+            if (err == PARSE_OK)
+            {
+                err = parse_rules(line + 82, len - 82, &r, &err_pos);
+                err_pos += (err == PARSE_OK) ? 0 : 82;
+            }
+            if (err == PARSE_OK)
+            {
+                err = check_rules(&puzzle, &r, &err_pos);
+            }
+            if (err == PARSE_OK)
+            {
+                unsigned long long puzzle_start = now_ns();
+                board original = puzzle;
+                int count_unsolved = solve_variant(&puzzle, &r);
+                record_puzzle(&stats, now_ns() - puzzle_start, count_unsolved == 0);
+                print_line(&puzzle);
+                // the rules engine records no steps, but each puzzle still gets a header so that
+                // the trace lines up with the output
+                if (trace_file)
+                {
+                    trace empty = {0};
+                    write_trace(trace_file, &original, count_unsolved == 0, &empty);
+                }
+            }
+        }
+        else
+        {
+            err = parse_record(line, len, &puzzle, &err_pos);
+            if (err == PARSE_OK)
+            {
+                board original = puzzle;
+                unsigned long long puzzle_start = now_ns();
+                int count_unsolved = solve_board(&puzzle, sched, log);
+                record_puzzle(&stats, now_ns() - puzzle_start, count_unsolved == 0);
+                print_line(&puzzle);
+                if (trace_file)
+                {
+                    write_trace(trace_file, &original, count_unsolved == 0, log);
+                }
+            }
+        }
+        if (err != PARSE_OK)
+        {
+            fprintf(stderr, "Error on line %d, position %d: %s\n", line_num, err_pos + 1, parse_error_message(err));
+            stats.invalid++;
+        }
+        if (metrics_path && (now_ns() - written_ns >= METRICS_INTERVAL_NS))
+        {
+            write_metrics(metrics_path, &stats, sched);
+            written_ns = now_ns();
+        }
+    }
+    free(data);
+
+    clock_t stop_time = clock();
+    fprintf(stderr, "Solved %llu, unable to solve %llu, invalid %llu\n", stats.solved, stats.unsolved, stats.invalid);
+    fprintf(stderr, "Execution time: %f seconds\n", (double)(stop_time - start_time) / CLOCKS_PER_SEC);
+    fprintf(stderr, "Latency: median %.1f, 99th percentile %.1f, max %.1f microseconds\n", latency_quantile(&stats, 0.5) / 1e3,
+            latency_quantile(&stats, 0.99) / 1e3, stats.max_ns / 1e3);
+    print_scheduler(sched);
+#ifdef SUDOKU_PROFILE
+    print_profile();
+#endif
+    if (metrics_path && write_metrics(metrics_path, &stats, sched))
+    {
+        fprintf(stderr, "Error: unable to write metrics file %s\n", metrics_path);
+        return 1;
+    }
+    return (stats.unsolved || stats.invalid) ? 1 : 0;
+}
+
+// print the easiest next step for every puzzle in a file, as text or as one JSON object per line
+// each line holds an 81-character puzzle, optionally followed by a space and the player's candidate marks
+// in the format read by parse_marks; return 0 if every line was valid and 1 otherwise
+int hint_file(const char *path, int json)
+{
+    size_t size;
+    char *data = read_file(path, &size);
+    if (data == 0)
+    {
+        return 1;
+    }
+
+    unsigned long long total_ns = 0;
+    int line_num = 0;
+    int count_hints = 0;
+    int count_invalid = 0;
+    const char *curr = data;
+    const char *end = data + size;
+    const char *line;
+    int len;
+    while ((line = next_line(&curr, end, &len, &line_num)) != 0)
+    {
+        int has_marks = (len > 81) && (line[81] == ' ');
+        board puzzle;
+        unsigned short marks[81];
+        int err_pos;
+        int err = parse_record(line, has_marks ? 81 : len, &puzzle, &err_pos);
+        if ((err == PARSE_OK) && has_marks)
+        {
+            err = parse_marks(line + 82, len - 82, marks, &err_pos);
+            err_pos += 82;
+        }
+        if (err != PARSE_OK)
+        {
+            fprintf(stderr, "Error on line %d, position %d: %s\n", line_num, err_pos + 1, parse_error_message(err));
+            count_invalid++;
+        }
+        else
+        {
+            step hint;
+            unsigned long long start = now_ns();
+            int found = find_hint(&puzzle, has_marks ? marks : 0, &hint);
+            total_ns += now_ns() - start;
+            count_hints++;
+            if (found && json)
+            {
+                print_step_json(stdout, &hint);
+                printf("\n");
+            }
+            else if (found)
+            {
+                print_step_text(stdout, &hint);
+            }
+            else
+            {
+                printf(json ? "null\n" : "no step found without guessing\n");
+            }
+        }
+    }
+    free(data);
+
+    fprintf(stderr, "Hints %d, invalid %d\n", count_hints, count_invalid);
+    fprintf(stderr, "Average time per hint: %f microseconds\n", count_hints ? (total_ns / 1000.0) / count_hints : 0.0);
+    return count_invalid ? 1 : 0;
+}
+
+// most guesses allowed for one puzzle when checking the engines against each other
+#define FUZZ_MAX_GUESSES 2000
+
+// return a random number from 0 to range - 1, using a generator that gives the same sequence
+// for the same seed on every platform so that fuzzing runs can be repeated
+static unsigned int next_random(unsigned long long *seed, unsigned int range)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (unsigned int)((*seed >> 32) % range);
+}
+
+// parse a puzzle one character at a time, as a reference for the vectorized parse_record
+static int parse_reference(const char *str, board *b, int *err_pos)
+{
+    for (int n = 0; n < 81; n++)
+    {
+        int val = parse_char(str[n]);
+        if (val < 0)
+        {
+            *err_pos = n;
+            return PARSE_BAD_CHAR;
+        }
+        b->value[n] = (unsigned char)val;
+    }
+    return check_contradictions(b, err_pos);
+}
+
+// check that a result keeps every digit of the original puzzle and has no digit repeated in a row, col,
+// or box; if complete is set, every square must also be filled in; return 1 if so and 0 otherwise
+static int check_result(const board *original, const board *result, int complete)
+{
+    int err_pos;
+    for (int n = 0; n < 81; n++)
+    {
+        if ((original->value[n] && (original->value[n] != result->value[n])) || (complete && (result->value[n] == 0)))
+        {
+            return 0;
+        }
+    }
+    return check_contradictions(result, &err_pos) == PARSE_OK;
+}
+
+// solve a puzzle with every engine and check each result, where solutions is the number of solutions
+// (0, 1, or 2 for more than one) and solution is the solution if there is exactly one
+// return 0 if every engine gave a correct result, otherwise return 1 and set reason to the problem
+static int check_engine_results(const board *puzzle, int solutions, const board *solution, const char **reason)
+{
+    static const char *engine_names[] = {"logic", "fixed", "adaptive", "guess", "rules engine"};
+    rules classic;
+    classic_rules(&classic);
+    finish_rules(&classic);
+
+    for (int engine = 0; engine < 5; engine++)
+    {
+        board result = *puzzle;
+        int count_unsolved;
+        if (engine < 4)
+        {
+            // limit the guesses so that a technique eliminating the wrong possibilities can't make
+            // the search take too long to finish
+            scheduler sched;
+            init_scheduler(&sched, engine);
+            sched.max_guesses = FUZZ_MAX_GUESSES;
+            count_unsolved = solve_board(&result, &sched, 0);
+        }
+        else
+        {
+            count_unsolved = solve_variant(&result, &classic);
+        }
+        *reason = engine_names[engine];
+        // a result claiming to be solved must be a valid completion of the puzzle, and a partial
+        // result must not contradict the puzzle or (if there is only one) its solution
+        if (check_result(puzzle, &result, count_unsolved == 0) == 0)
+        {
+            return 1;
+        }
+        if ((count_unsolved == 0) && (solutions == 0))
+        {
+            return 1;
+        }
+        if ((count_unsolved != 0) && (solutions > 0) && (engine != POLICY_LOGIC))
+        {
+            return 1;
+        }
+        for (int n = 0; (n < 81) && (solutions == 1); n++)
+        {
+            if (result.value[n] && (result.value[n] != solution->value[n]))
+            {
+                return 1;
+            }
+        }
+    }
+
+    // a hint must not fill in or eliminate anything that disagrees with the solution
+    step hint;
+    *reason = "hint";
+    if ((solutions == 1) && find_hint(puzzle, 0, &hint))
+    {
+        int x = solution->value[hint.square];
+        if ((hint.digit && (hint.digit != x)) || (hint.eliminated & (1 << x)))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// solve a puzzle with every engine, return 0 if they all gave correct results and 1 otherwise
+int check_engines(const board *puzzle, const char **reason)
+{
+    rules classic;
+    classic_rules(&classic);
+    finish_rules(&classic);
+    unsigned short poss[81];
+    for (int n = 0; n < 81; n++)
+    {
+        poss[n] = puzzle->value[n] ? (unsigned short)(1 << puzzle->value[n]) : 0x3FE;
+    }
+    int solutions = count_solutions(&classic, poss, 2);
+    board solution = *puzzle;
+    if (solutions == 1)
+    {
+        solve_variant(&solution, &classic);
+    }
+    return check_engine_results(puzzle, solutions, &solution, reason);
+}
+
+// check that a variant result keeps every digit of the original puzzle, fills in every square, has no digit
+// repeated in a unit or cage, and adds up to the sum of each cage; return 1 if so and 0 otherwise
+static int check_variant_result(const board *original, const board *result, const rules *r)
+{
+    int err_pos;
+    for (int n = 0; n < 81; n++)
+    {
+        if ((original->value[n] && (original->value[n] != result->value[n])) || (result->value[n] == 0))
+        {
+            return 0;
+        }
+    }
+    if (check_rules(result, r, &err_pos) != PARSE_OK)
+    {
+        return 0;
+    }
+    for (int c = 0; c < r->num_cages; c++)
+    {
+        int sum = 0;
+        for (int index = 0; index < r->cage_size[c]; index++)
+        {
+            sum += result->value[r->cage_cells[c][index]];
+        }
+        if (sum != r->cage_sum[c])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// solve a variant puzzle with the rules engine, check the result, and check that counting the solutions agrees,
+// where known is a solution of the puzzle (or null if none is known)
+// return 0 if everything agreed, otherwise return 1 and set reason to the problem
+int check_variant(const board *puzzle, const rules *r, const board *known, const char **reason)
+{
+    board result = *puzzle;
+    int count_unsolved = solve_variant(&result, r);
+    *reason = "rules engine";
+    if ((known && count_unsolved) || ((count_unsolved == 0) && (check_variant_result(puzzle, &result, r) == 0)))
+    {
+        return 1;
+    }
+    unsigned short poss[81];
+    for (int n = 0; n < 81; n++)
+    {
+        poss[n] = puzzle->value[n] ? (unsigned short)(1 << puzzle->value[n]) : 0x3FE;
+    }
+    int solutions = count_solutions(r, poss, 2);
+    *reason = "solution count";
+    if ((solutions == 0) != (count_unsolved != 0))
+    {
+        return 1;
+    }
+    return known && (solutions == 1) && (memcmp(result.value, known->value, 81) != 0);
+}
+
+// remove digits from a puzzle that fails the checks for as long as it still fails for the same reason,
+// so that the puzzle left is the smallest one that shows the problem; r is null for a classic puzzle,
+// and known is a solution of a variant puzzle (which stays a solution as digits are removed)
+void shrink_puzzle(board *puzzle, const rules *r, const board *known, const char *reason)
+{
+    const char *smaller_reason;
+    int progress_made = 1;
+    while (progress_made)
+    {
+        progress_made = 0;
+        for (int n = 0; n < 81; n++)
+        {
+            if (puzzle->value[n] == 0)
+            {
+                continue;
+            }
+            board smaller = *puzzle;
+            smaller.value[n] = 0;
+            int failed = r ? check_variant(&smaller, r, known, &smaller_reason) : check_engines(&smaller, &smaller_reason);
+            if (failed && (strcmp(smaller_reason, reason) == 0))
+            {
+                *puzzle = smaller;
+                progress_made = 1;
+            }
+        }
+    }
+}
 
-    // solve the puzzle
-    while (count_unsolved)
+// fill in b with a random solved puzzle that follows the given rules
+static void random_solution(board *b, const rules *r, unsigned long long *seed)
+{
+    unsigned short poss[81];
+    int solved = 0;
+    while (solved == 0)
     {
-        int prev_count = -1;
-        while (count_unsolved && (count_unsolved != prev_count))
+        // fill in the first row with a random order of the digits and a few other random squares,
+        // then solve the rest of the puzzle
+        int digits[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+        for (int n = 8; n > 0; n--)
         {
-            prev_count = count_unsolved;
-            // update possibilities for all unsolved squares
-            for (int i = 0; i < 9; i++)
+            int swap = (int)next_random(seed, (unsigned int)(n + 1));
+            int temp = digits[n];
+            digits[n] = digits[swap];
+            digits[swap] = temp;
+        }
+        for (int n = 0; n < 81; n++)
+        {
+            poss[n] = (n < 9) ? (unsigned short)(1 << digits[n]) : 0x3FE;
+        }
+        for (int count = 0; count < 6; count++)
+        {
+            int n = 9 + (int)next_random(seed, 72);
+            poss[n] = (unsigned short)(1 << (1 + next_random(seed, 9)));
+        }
+        solved = variant_search(r, poss);
+    }
+    for (int n = 0; n < 81; n++)
+    {
+        for (int x = 1; x < 10; x++)
+        {
+            if (poss[n] == (1 << x))
             {
-                for (int j = 0; j < 3; j++)
+                b->value[n] = (unsigned char)x;
+            }
+        }
+    }
+}
+
+// generate a random puzzle: kind 0 removes digits from a solved puzzle at random (which usually leaves
+// more than one solution), kind 1 removes digits for as long as there is still only one solution,
+// and kind 2 then changes one of the remaining digits, which usually leaves no solution
+static void random_puzzle(board *b, int kind, const rules *classic, unsigned long long *seed)
+{
+    random_solution(b, classic, seed);
+    int order[81];
+    for (int n = 0; n < 81; n++)
+    {
+        order[n] = n;
+    }
+    for (int n = 80; n > 0; n--)
+    {
+        int swap = (int)next_random(seed, (unsigned int)(n + 1));
+        int temp = order[n];
+        order[n] = order[swap];
+        order[swap] = temp;
+    }
+    int keep = 17 + (int)next_random(seed, 24);
+    for (int index = 0; index < 81; index++)
+    {
+        int n = order[index];
+        if (kind == 0)
+        {
+            if (index >= keep)
+            {
+                b->value[n] = 0;
+            }
+            continue;
+        }
+        // only remove the digit if the puzzle still has a single solution without it
+        unsigned short poss[81];
+        int removed = b->value[n];
+        b->value[n] = 0;
+        for (int m = 0; m < 81; m++)
+        {
+            poss[m] = b->value[m] ? (unsigned short)(1 << b->value[m]) : 0x3FE;
+        }
+        if (count_solutions(classic, poss, 2) != 1)
+        {
+            b->value[n] = (unsigned char)removed;
+        }
+    }
+    if (kind == 2)
+    {
+        // change a random digit to another digit that isn't repeated in its row, col, or box
+        int err_pos;
+        for (int tries = 0; tries < 100; tries++)
+        {
+            int n = (int)next_random(seed, 81);
+            int old = b->value[n];
+            if (old == 0)
+            {
+                continue;
+            }
+            b->value[n] = (unsigned char)(1 + next_random(seed, 9));
+            if ((b->value[n] != old) && (check_contradictions(b, &err_pos) == PARSE_OK))
+            {
+                break;
+            }
+            b->value[n] = (unsigned char)old;
+        }
+    }
+}
+
+// make random variant rules and a solved puzzle b that follows them: kind 0 adds the diagonals of X-Sudoku,
+// kind 1 makes jigsaw regions by swapping squares holding the same digit between boxes, and kind 2
+// adds Killer cages of up to 5 squares, leaving about a quarter of the squares in no cage
+static void random_variant(board *b, rules *r, int kind, unsigned long long *seed)
+{
+    int err_pos;
+    classic_rules(r);
+    if (kind == 0)
+    {
+        parse_rules("x", 1, r, &err_pos);
+    }
+    finish_rules(r);
+    random_solution(b, r, seed);
+    if (kind == 1)
+    {
+        // swapping two squares with the same digit keeps each region's digits different
+        int region[81];
+        for (int n = 0; n < 81; n++)
+        {
+            region[n] = (3 * (n / 27)) + ((n % 9) / 3);
+        }
+        for (int swaps = 0; swaps < 40; swaps++)
+        {
+            int n = (int)next_random(seed, 81);
+            int m = (int)next_random(seed, 81);
+            if ((b->value[n] == b->value[m]) && (region[n] != region[m]))
+            {
+                int temp = region[n];
+                region[n] = region[m];
+                region[m] = temp;
+            }
+        }
+        int sizes[9] = {0};
+        for (int n = 0; n < 81; n++)
+        {
+            r->units[18 + region[n]][sizes[region[n]]++] = (unsigned char)n;
+        }
+    }
+    else if (kind == 2)
+    {
+        // grow each cage from a square in no cage into neighbouring squares with digits not already in it,
+        // stopping at 52 cages so that the rules can be written with cage letters
+        int cage_of[81];
+        for (int n = 0; n < 81; n++)
+        {
+            cage_of[n] = -1;
+        }
+        for (int n = 0; (n < 81) && (r->num_cages < 52); n++)
+        {
+            if ((cage_of[n] >= 0) || (next_random(seed, 4) == 0))
+            {
+                continue;
+            }
+            int c = r->num_cages++;
+            int size = 1 + (int)next_random(seed, 5);
+            int used = 1 << b->value[n];
+            cage_of[n] = c;
+            r->cage_cells[c][r->cage_size[c]++] = (unsigned char)n;
+            for (int tries = 0; (tries < 20) && (r->cage_size[c] < size); tries++)
+            {
+                int from = r->cage_cells[c][next_random(seed, r->cage_size[c])];
+                int direction = (int)next_random(seed, 4);
+                int m = from + ((direction == 0) ? -9 : (direction == 1) ? 9 : (direction == 2) ? -1 : 1);
+                if ((m < 0) || (m > 80) || ((direction >= 2) && ((m / 9) != (from / 9))) || (cage_of[m] >= 0) ||
+                    (used & (1 << b->value[m])))
                 {
-                    for (int k = 0; k < 3; k++)
-                    {
-                        square *curr_square = &sudoku[i][j][k];
-                        if (curr_square->value == 0)
-                        {
-                            count_unsolved -= update_unsolved(curr_square, rows, cols, boxes);
-                        }
-                    }
+                    continue;
                 }
+                used |= 1 << b->value[m];
+                cage_of[m] = c;
+                r->cage_cells[c][r->cage_size[c]++] = (unsigned char)m;
             }
-            // check for numbers which have only one possible position in any row, col, or box
-            for (int num = 0; num < 9; num++)
+            for (int index = 0; index < r->cage_size[c]; index++)
             {
-                // check rows
-                square *row_unsolved[9] = {0};
-                find_unsolved('r', num, sudoku, row_unsolved);
-                count_unsolved -= check_unique(row_unsolved, rows, cols, boxes);
-                // check cols
-                square *col_unsolved[9] = {0};
-                find_unsolved('c', num, sudoku, col_unsolved);
-                count_unsolved -= check_unique(col_unsolved, rows, cols, boxes);
-                // check boxes
-                square *box_unsolved[9] = {0};
-                find_unsolved('b', num, sudoku, box_unsolved);
-                count_unsolved -= check_unique(box_unsolved, rows, cols, boxes);
+                r->cage_sum[c] = (unsigned char)(r->cage_sum[c] + b->value[r->cage_cells[c][index]]);
             }
         }
-        if (count_unsolved == 0)
+    }
+    finish_rules(r);
+}
+
+// print a variant puzzle as a line of a puzzle file, followed by a space and its rules in the format read by
+// parse_rules, so that a failing puzzle can be solved again
+static void print_variant(const board *b, const rules *r)
+{
+    for (int n = 0; n < 81; n++)
+    {
+        putchar('0' + b->value[n]);
+    }
+    putchar(' ');
+    rules classic;
+    classic_rules(&classic);
+    if (r->num_units == 29)
+    {
+        printf("x ");
+    }
+    if (memcmp(r->units[18], classic.units[18], 81) != 0)
+    {
+        char region[81];
+        for (int u = 0; u < 9; u++)
         {
-            break;
+            for (int index = 0; index < 9; index++)
+            {
+                region[r->units[18 + u][index]] = (char)('1' + u);
+            }
+        }
+        printf("j=%.81s ", region);
+    }
+    if (r->num_cages > 0)
+    {
+        // cages are lettered and their sums listed in the order each one first appears
+        char letters[81];
+        int letter_of[MAX_CAGES];
+        int order[MAX_CAGES];
+        int count = 0;
+        memset(letters, '.', sizeof(letters));
+        for (int c = 0; c < r->num_cages; c++)
+        {
+            letter_of[c] = -1;
         }
-        // if methods above can't solve puzzle, check for pairs
-        if (check_pairs(sudoku) == 0)
+        for (int n = 0; n < 81; n++)
         {
-            // if checking pairs does not make progress, check for triples
-            if (check_triples(sudoku) == 0)
+            for (int c = 0; c < r->num_cages; c++)
             {
-                // if none of the above methods made any progress, this program is unable to solve the puzzle
-                break;
+                for (int index = 0; index < r->cage_size[c]; index++)
+                {
+                    if (r->cage_cells[c][index] != n)
+                    {
+                        continue;
+                    }
+                    if (letter_of[c] < 0)
+                    {
+                        order[count] = c;
+                        letter_of[c] = count++;
+                    }
+                    letters[n] = (char)((letter_of[c] < 26) ? ('A' + letter_of[c]) : ('a' + letter_of[c] - 26));
+                }
             }
         }
+        printf("k=%.81s:", letters);
+        for (int index = 0; index < count; index++)
+        {
+            printf("%s%d", index ? "," : "", r->cage_sum[order[index]]);
+        }
     }
+    printf("\n");
+}
 
-    // print solution
-    if (count_unsolved)
+// check the vectorized parser against the reference parser on a string made by changing random
+// characters of a puzzle to random bytes, return 0 if they agree and 1 otherwise
+static int check_parser(const board *b, unsigned long long *seed)
+{
+    char str[81];
+    for (int n = 0; n < 81; n++)
     {
-        printf("Unable to solve puzzle. Partial solution:");
+        str[n] = b->value[n] ? (char)('0' + b->value[n]) : '.';
     }
-    else
+    int changes = (int)next_random(seed, 4);
+    for (int count = 0; count < changes; count++)
     {
-        printf("Solution:");
+        str[next_random(seed, 81)] = (char)next_random(seed, 256);
+    }
+    board fast;
+    board reference;
+    int fast_pos = 0;
+    int reference_pos = 0;
+    int fast_err = parse_record(str, 81, &fast, &fast_pos);
+    int reference_err = parse_reference(str, &reference, &reference_pos);
+    if ((fast_err != reference_err) || (fast_pos != reference_pos))
+    {
+        return 1;
     }
-    print_puzzle(sudoku);
+    return (fast_err == PARSE_OK) && (memcmp(fast.value, reference.value, 81) != 0);
+}
 
-    // stop timer and print time
-    clock_t stop_time = clock();
-    printf("Execution time: %f seconds\n\n", (double)(stop_time - start_time) / CLOCKS_PER_SEC);
+// generate count random puzzles from seed, solve each one with every engine, and print any puzzle
+// that gives a wrong result along with the smallest puzzle found that shows the same problem
+// classic puzzles are checked with check_engines, and X, jigsaw, and Killer puzzles, which keep a random
+// number of the digits of a known solution, with check_variant
+// return 0 if every result was correct and 1 otherwise
+int fuzz_engines(int count, unsigned long long seed)
+{
+    static const char *kind_names[] = {"random", "unique", "changed", "X", "jigsaw", "Killer"};
+    rules classic;
+    classic_rules(&classic);
+    finish_rules(&classic);
+    if (seed == 0)
+    {
+        seed = 1;
+    }
+    int failures = 0;
+    for (int index = 0; index < count; index++)
+    {
+        board puzzle = {0};
+        int kind = index % 6;
+        const char *reason = "parser";
+        if (kind >= 3)
+        {
+            rules r;
+            board known;
+            random_variant(&known, &r, kind - 3, &seed);
+            // Killer cages constrain the puzzle enough that far fewer digits are needed
+            int keep = (kind == 5) ? (int)next_random(&seed, 20) : (20 + (int)next_random(&seed, 20));
+            puzzle = known;
+            for (int removed = 0; removed < 81 - keep; removed++)
+            {
+                puzzle.value[next_random(&seed, 81)] = 0;
+            }
+            if (check_variant(&puzzle, &r, &known, &reason))
+            {
+                failures++;
+                printf("Failed (%s, %s puzzle):\n", reason, kind_names[kind]);
+                print_variant(&puzzle, &r);
+                shrink_puzzle(&puzzle, &r, &known, reason);
+                printf("Smallest failing puzzle:\n");
+                print_variant(&puzzle, &r);
+            }
+            continue;
+        }
+        random_puzzle(&puzzle, kind, &classic, &seed);
+        if (check_parser(&puzzle, &seed) || check_engines(&puzzle, &reason))
+        {
+            failures++;
+            printf("Failed (%s, %s puzzle):\n", reason, kind_names[kind]);
+            print_line(&puzzle);
+            if (strcmp(reason, "parser"))
+            {
+                shrink_puzzle(&puzzle, 0, 0, reason);
+                printf("Smallest failing puzzle:\n");
+                print_line(&puzzle);
+            }
+        }
+    }
+    fprintf(stderr, "Checked %d puzzles, %d failed\n", count, failures);
+    return failures ? 1 : 0;
+}
+
+#ifdef SUDOKU_FUZZER
+// entry point for libFuzzer: the first 81 bytes are a puzzle, checked against the reference parser and
+// then solved by every engine, or if they are followed by a space and variant rules, by the rules engine
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size)
+{
+    static int initialized = 0;
+    if (initialized == 0)
+    {
+        init_cage_table();
+        initialized = 1;
+    }
+    if (size < 81)
+    {
+        return 0;
+    }
+    board puzzle;
+    board reference;
+    int err_pos = 0;
+    int reference_pos = 0;
+    int err = parse_record((const char *)data, 81, &puzzle, &err_pos);
+    int reference_err = parse_reference((const char *)data, &reference, &reference_pos);
+    if ((err != reference_err) || (err_pos != reference_pos))
+    {
+        abort();
+    }
+    if ((size > 82) && (data[81] == ' '))
+    {
+        rules r;
+        const char *reason;
+        if ((parse_digits((const char *)data, 81, &puzzle, &err_pos) == PARSE_OK) &&
+            (parse_rules((const char *)data + 82, (int)(size - 82), &r, &err_pos) == PARSE_OK) &&
+            (check_rules(&puzzle, &r, &err_pos) == PARSE_OK) && check_variant(&puzzle, &r, 0, &reason))
+        {
+            abort();
+        }
+        return 0;
+    }
+    const char *reason;
+    if ((err == PARSE_OK) && check_engines(&puzzle, &reason))
+    {
+        abort();
+    }
+    return 0;
 }
+#endif
 
 // check if user wants to continue, return 1 if yes and 0 if no
 int check_continue()
@@ -871,13 +3414,147 @@ int check_continue()
     }
 }
 
-int main()
+// print how to run the program
+void print_usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-p logic|fixed|adaptive|guess] [-t trace file] [-m metrics file] [puzzle file]\n", name);
+    fprintf(stderr, "       %s -n puzzle file [-j]\n", name);
+    fprintf(stderr, "       %s -d trace file [-j]\n", name);
+    fprintf(stderr, "       %s -f number of puzzles [-s seed]\n", name);
+}
+
+// solve puzzles from the file given as an argument, or interactively if no file is given
+// the -p option chooses the scheduler policy for when to start guessing, and the -t option
+// records the steps taken for each puzzle in a trace file, which the -d option prints
+// as text (or as JSON with the -j option); the -m option writes metrics for a puzzle file in the Prometheus
+// text format; the -n option prints only the next step for each puzzle,
+// and the -f option checks every engine against random puzzles generated from the seed given by -s
+// main is left out of the libFuzzer target and of library builds (-DSUDOKU_LIBRARY), such as the Python module
+#if !defined(SUDOKU_FUZZER) && !defined(SUDOKU_LIBRARY)
+int main(int argc, char *argv[])
 {
-    int keep_playing = 1;
-    char user_input[2] = {0};
-    while (keep_playing)
+    static const char *policy_names[] = {"logic", "fixed", "adaptive", "guess"};
+    int policy = POLICY_ADAPTIVE;
+    const char *path = 0;
+    const char *trace_path = 0;
+    const char *decode_path = 0;
+    const char *metrics_path = 0;
+    int next_step = 0;
+    int json = 0;
+    int fuzz_count = 0;
+    unsigned long long seed = 1;
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if ((strcmp(argv[arg], "-p") == 0) && (arg + 1 < argc))
+        {
+            arg++;
+            policy = -1;
+            for (int p = 0; p < 4; p++)
+            {
+                if (strcmp(argv[arg], policy_names[p]) == 0)
+                {
+                    policy = p;
+                }
+            }
+            if (policy < 0)
+            {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[arg], "-t") == 0) && (arg + 1 < argc))
+        {
+            trace_path = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-m") == 0) && (arg + 1 < argc))
+        {
+            metrics_path = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-d") == 0) && (arg + 1 < argc))
+        {
+            decode_path = argv[++arg];
+        }
+        else if ((strcmp(argv[arg], "-f") == 0) && (arg + 1 < argc))
+        {
+            fuzz_count = atoi(argv[++arg]);
+        }
+        else if ((strcmp(argv[arg], "-s") == 0) && (arg + 1 < argc))
+        {
+            seed = strtoull(argv[++arg], 0, 10);
+        }
+        else if (strcmp(argv[arg], "-n") == 0)
+        {
+            next_step = 1;
+        }
+        else if (strcmp(argv[arg], "-j") == 0)
+        {
+            json = 1;
+        }
+        else if ((argv[arg][0] == '-') || path)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            path = argv[arg];
+        }
+    }
+    if (decode_path)
+    {
+        return decode_trace(decode_path, json);
+    }
+    init_cage_table();
+    if (fuzz_count > 0)
+    {
+        return fuzz_engines(fuzz_count, seed);
+    }
+    if (next_step)
+    {
+        if (path == 0)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return hint_file(path, json);
+    }
+
+    // allocate the trace buffer once, so that recording a step never needs to allocate or write to a file
+    trace log = {0};
+    FILE *trace_file = 0;
+    if (trace_path)
+    {
+        trace_file = fopen(trace_path, "wb");
+        log.capacity = TRACE_CAPACITY;
+        log.steps = malloc(sizeof(step) * TRACE_CAPACITY);
+        if ((trace_file == 0) || (log.steps == 0))
+        {
+            fprintf(stderr, "Error: unable to create trace file %s\n", trace_path);
+            return 1;
+        }
+    }
+
+    scheduler sched;
+    init_scheduler(&sched, policy);
+    int result = 0;
+    if (path)
     {
-        solve_puzzle();
-        keep_playing = check_continue();
+        result = solve_file(path, &sched, trace_file ? &log : 0, trace_file, metrics_path);
     }
-}
\ No newline at end of file
+    else
+    {
+        int keep_playing = 1;
+        while (keep_playing)
+        {
+            solve_puzzle(&sched, trace_file ? &log : 0, trace_file);
+            keep_playing = check_continue();
+        }
+    }
+    if (trace_file)
+    {
+        fclose(trace_file);
+        free(log.steps);
+    }
+    return result;
+}
+#endif
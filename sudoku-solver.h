@@ -0,0 +1,147 @@
+// types and functions shared by the command-line solver and the programs built on its solver core
+#ifndef SUDOKU_SOLVER_H
+#define SUDOKU_SOLVER_H
+
+#include <stddef.h>
+
+// error codes returned by parse_record
+#define PARSE_OK 0
+#define PARSE_BAD_LENGTH 1
+#define PARSE_BAD_CHAR 2
+#define PARSE_DUP_ROW 3
+#define PARSE_DUP_COL 4
+#define PARSE_DUP_BOX 5
+#define PARSE_BAD_MARKS 6
+#define PARSE_BAD_RULES 7
+#define PARSE_DUP_UNIT 8
+
+// compact representation of a puzzle, used for input and output
+typedef struct Board
+{
+    // value[n] is the number in square n (counting across each row from the top left),
+    // or 0 if the square is blank or still undetermined
+    unsigned char value[81];
+} board;
+
+// techniques the scheduler chooses between once the basic checks stop making progress
+#define TECH_PAIRS 0
+#define TECH_TRIPLES 1
+#define NUM_TECHNIQUES 2
+
+// policies for when to stop using logical techniques and start guessing
+// POLICY_LOGIC never guesses, so some puzzles are left partially solved
+// POLICY_FIXED tries every technique in the original order before guessing
+// POLICY_ADAPTIVE reorders techniques by yield and skips those that are slower than guessing
+// POLICY_GUESS guesses as soon as the basic checks stop making progress
+#define POLICY_LOGIC 0
+#define POLICY_FIXED 1
+#define POLICY_ADAPTIVE 2
+#define POLICY_GUESS 3
+
+// cost and yield of each technique, collected over every puzzle solved with the scheduler
+typedef struct Scheduler
+{
+    int policy;
+    // order in which the techniques are tried
+    int order[NUM_TECHNIQUES];
+    // calls, possibilities eliminated, and nanoseconds spent for each technique
+    unsigned long long calls[NUM_TECHNIQUES], eliminations[NUM_TECHNIQUES], ns[NUM_TECHNIQUES];
+    // the same for guessing, counting the possibilities that were left when guessing started
+    unsigned long long search_calls, search_eliminations, search_ns;
+    // times the adaptive policy has skipped each technique since it was last tried, and how many
+    // skips it waits before trying the technique again
+    unsigned long long skipped[NUM_TECHNIQUES], probe_interval[NUM_TECHNIQUES];
+    // number of guesses made, and the most guesses allowed before giving up (0 for no limit)
+    unsigned long long guesses, max_guesses;
+} scheduler;
+
+// latency histograms keep 16 buckets for each power of two, so every value is recorded to within 1/16
+// of its size; values below 32 nanoseconds get a bucket each, and the largest 64-bit value lands in the last bucket
+#define LATENCY_SUB_BITS 4
+#define LATENCY_BUCKETS (61 << LATENCY_SUB_BITS)
+
+// counts collected while solving, owned by a single thread so that recording needs no locks or atomics;
+// the counts of several threads are combined with merge_metrics and merge_scheduler when they are reported
+typedef struct Metrics
+{
+    unsigned long long solved, unsolved, invalid;
+    // number of puzzles whose solving time fell in each bucket, and the total and longest time in nanoseconds
+    unsigned long long latency[LATENCY_BUCKETS];
+    unsigned long long latency_ns, max_ns;
+} metrics;
+
+// kinds of step recorded in a trace
+// STEP_SINGLE fills in a square with only one possibility left
+// STEP_UNIQUE fills in the only square in a row, col, or box that could contain a digit
+// STEP_PAIR and STEP_TRIPLE eliminate possibilities because of a pair or triple found in a row, col, or box
+// STEP_GUESS fills in a square by guessing, and STEP_BACKTRACK undoes a guess and every step after it
+#define STEP_SINGLE 0
+#define STEP_UNIQUE 1
+#define STEP_PAIR 2
+#define STEP_TRIPLE 3
+#define STEP_GUESS 4
+#define STEP_BACKTRACK 5
+
+// units are numbered 0-8 for rows, 9-17 for cols, and 18-26 for boxes
+#define UNIT_ROW 0
+#define UNIT_COL 9
+#define UNIT_BOX 18
+#define UNIT_NONE 255
+
+// one step taken by the solver, packed into 8 bytes
+typedef struct Step
+{
+    // kind of step, unit it applies to, square it changes (0-80), and digit filled in (0 if none)
+    unsigned char kind, unit, square, digit;
+    // bit d of digits is set for each digit d in the pair or triple, and bit d of eliminated
+    // is set for each possibility d that was eliminated from the square
+    unsigned short digits, eliminated;
+} step;
+
+// log of the steps taken to solve a puzzle, written into a buffer allocated up front
+typedef struct Trace
+{
+    step *steps;
+    // number of steps recorded, room in the buffer, and number of steps that did not fit
+    unsigned int count, capacity, dropped;
+    // if set, the pair and triple checks stop as soon as the buffer is full (used to find a single hint)
+    unsigned int stop_when_full;
+} trace;
+
+// number of steps that fit in the trace for one puzzle
+#define TRACE_CAPACITY 65536
+
+// read a whole file into memory, return the contents (which must be freed) or null on error
+char *read_file(const char *path, size_t *size);
+
+// return the next line that isn't blank in a file read into memory, advancing *curr and line_num past it,
+// or null when there are no lines left
+const char *next_line(const char **curr, const char *end, int *len, int *line_num);
+
+// return the time in nanoseconds on a monotonic clock, for measuring intervals
+unsigned long long now_ns(void);
+
+// parse a puzzle or the player's candidate marks, returning PARSE_OK or an error code
+// and setting err_pos to the position of the error
+const char *parse_error_message(int code);
+int check_contradictions(const board *b, int *err_pos);
+int parse_digits(const char *str, int len, board *b, int *err_pos);
+int parse_record(const char *str, int len, board *b, int *err_pos);
+int parse_marks(const char *str, int len, unsigned short marks[81], int *err_pos);
+
+// solve a classic puzzle in place with the given scheduler, returning the number of squares left unsolved
+void init_scheduler(scheduler *sched, int policy);
+void merge_scheduler(scheduler *total, const scheduler *sched);
+int solve_board(board *b, scheduler *sched, trace *log);
+int find_hint(const board *b, const unsigned short marks[81], step *hint);
+
+// prepare the tables used by the variant engine, once before any variant puzzle is solved
+void init_cage_table(void);
+
+// collect and report metrics
+void record_puzzle(metrics *m, unsigned long long ns, int solved);
+void merge_metrics(metrics *total, const metrics *m);
+unsigned long long latency_quantile(const metrics *m, double q);
+int write_metrics(const char *path, const metrics *m, const scheduler *sched);
+
+#endif